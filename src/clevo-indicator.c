@@ -30,89 +30,113 @@
  ============================================================================
  */
 
-#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <math.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/io.h>
 #include <sys/mman.h>
 #include <sys/prctl.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <libayatana-appindicator/app-indicator.h>
+#include <glib-unix.h>
 #include "privilege_manager.h"
+#include "ec_backend.h"
+#include "ec_cache.h"
+#include "ec_command.h"
+#include "ec_daemon.h"
+#include "ec_instance.h"
+#include "ec_lock.h"
+#include "ec_loop.h"
+#include "ec_power.h"
+#include "ec_rt.h"
+#include "ec_sim.h"
+#include "ec_snapshot.h"
+#include "ec_stats.h"
+#include "ec_telemetry.h"
+#include "ec_shm.h"
+#include "ec_trace.h"
+#include "fan_pid.h"
 
 #define NAME "clevo-indicator"
 
-#define EC_SC 0x66
-#define EC_DATA 0x62
-
-#define IBF 1
-#define OBF 0
-#define EC_SC_READ_CMD 0x80
-
-/* EC registers can be read by EC_SC_READ_CMD or /sys/kernel/debug/ec/ec0/io:
- *
- * 1. modprobe ec_sys
- * 2. od -Ax -t x1 /sys/kernel/debug/ec/ec0/io
- */
+#define MAX_FAN_RPM 4400.0
 
-#define EC_REG_SIZE 0x100
-#define EC_REG_CPU_TEMP 0x07
-#define EC_REG_GPU_TEMP 0xCD
-#define EC_REG_FAN_DUTY 0xCE
-#define EC_REG_FAN_RPMS_HI 0xD0
-#define EC_REG_FAN_RPMS_LO 0xD1
+// Indicator label refresh period
+#define UI_UPDATE_MS 500
 
-#define MAX_FAN_RPM 4400.0
+// Duty the worker leaves the fan at on shutdown unless it was already
+// spinning faster, so an exit never reduces cooling below this
+#define SAFE_FAN_DUTY 70
 
 typedef enum {
     NA = 0, AUTO = 1, MANUAL = 2
 } MenuItemType;
 
+// One consistent reading of the registers the controller cares about
+typedef struct {
+    int cpu_temp;
+    int gpu_temp;
+    int fan_duty;
+    int fan_rpms;
+} ec_sample_t;
+
 static void main_init_share(void);
 static int main_ec_worker(void);
 static void main_ui_worker(int argc, char** argv);
 static void main_on_sigchld(int signum);
+static gboolean main_on_worker_exit(gint fd, GIOCondition condition, gpointer user_data);
+static void ec_worker_shutdown(uint64_t requested_ns);
 static void main_on_sigterm(int signum);
 static int main_dump_fan(void);
 static int main_test_fan(int duty_percentage);
+static int main_replay(const char* path);
+static int main_read_telemetry(void);
+static int main_daemon(void);
+static int main_client(int argc, char** argv);
+static int main_client_status(void);
+static gboolean main_on_daemon_sample(gint fd, GIOCondition condition, gpointer user_data);
+static void ui_current_sample(ec_telemetry_t* sample);
+static void trace_record_sample(const ec_sample_t* sample);
+static void publish_sample(const ec_sample_t* sample, uint64_t woke_ns);
+static int ec_apply_command(const ec_command_t* command);
+static int ec_apply_forwarded_command(int fd, ec_loop_t* loop);
+static int ec_worker_wait(ec_loop_t* loop, int parent_pidfd);
+static uint64_t worker_phase(uint64_t* phase_ns, ec_phase_t phase, uint64_t since_ns);
 static gboolean ui_update(gpointer user_data);
 static void ui_command_set_fan(long fan_duty);
 static void ui_command_quit(gchar* command);
 static void ui_toggle_menuitems(int fan_duty);
-static void ec_on_sigterm(int signum);
+static void ui_schedule_update(void);
 static int ec_init(void);
-static int ec_auto_duty_adjust(void);
-static int ec_query_cpu_temp(void);
-static int ec_query_gpu_temp(void);
-static int ec_query_fan_duty(void);
-static int ec_query_fan_rpms(void);
+static void ec_prepare_sysfs(void);
+static ec_backend_t* ec_open(ec_backend_type_t type);
+static int ec_auto_duty_adjust(uint64_t now_ns);
+static uint64_t ec_sample_clock_ns(void);
+static int ec_query_sample(ec_sample_t* sample);
+static void ec_sample_from_regs(const uint8_t* regs, ec_sample_t* sample);
+static int ec_read_registers(const uint8_t* regs, uint8_t* out, size_t n);
 static int ec_write_fan_duty(int duty_percentage);
-static int ec_io_wait(const uint32_t port, const uint32_t flag,
-        const char value);
-static uint8_t ec_io_read(const uint32_t port);
-static int ec_io_do(const uint32_t cmd, const uint32_t port,
-        const uint8_t value);
 static int calculate_fan_duty(int raw_duty);
 static int calculate_fan_rpms(int raw_rpm_high, int raw_rpm_low);
-static int check_proc_instances(const char* proc_name);
 static void get_time_string(char* buffer, size_t max, const char* format);
 static void signal_term(__sighandler_t handler);
+static void signal_term_set(sigset_t* signals);
 static void parse_command_line(int argc, char* argv[]);
 static bool setup_privileges(void);
 static void show_privilege_help(void);
 static void status_display_init(void);
-static void status_display_update(void);
 static void status_display_update_with_control(void);
+static void status_display_render(const ec_history_t* history);
 static void status_display_cleanup(void);
 static void status_display_show_help(void);
 static char* status_get_temp_bar(int temp, int max_temp);
@@ -144,31 +168,109 @@ struct {
 
 static int menuitem_count = (sizeof(menuitems) / sizeof(menuitems[0]));
 
+// Registers making up one ec_sample_t, in the order ec_sample_from_regs expects
+static const uint8_t ec_sample_regs[] = {
+        EC_REG_CPU_TEMP,
+        EC_REG_GPU_TEMP,
+        EC_REG_FAN_DUTY,
+        EC_REG_FAN_RPMS_HI,
+        EC_REG_FAN_RPMS_LO
+};
+
+#define EC_SAMPLE_REG_COUNT (sizeof(ec_sample_regs) / sizeof(ec_sample_regs[0]))
+#define EC_EXTRA_REG_MAX 16
+
+// Extra registers (--ec-extra-regs) read along with every sample
+static uint8_t ec_extra_regs[EC_EXTRA_REG_MAX];
+static uint8_t ec_extra_values[EC_EXTRA_REG_MAX];
+static int ec_extra_reg_count = 0;
+
+static ec_backend_t* ec_backend = NULL;
+static ec_backend_type_t backend_type = EC_BACKEND_AUTO;
+
+// Page shared by the UI and the worker. The UI-written control fields and
+// the worker-published sample live on separate cache lines.
 struct {
-    volatile int exit;
-    volatile int cpu_temp;
-    volatile int gpu_temp;
-    volatile int fan_duty;
-    volatile int fan_rpms;
-    volatile int auto_duty;
-    volatile int auto_duty_val;
-    volatile int manual_next_fan_duty;
-    volatile int manual_prev_fan_duty;
+    // written by the UI, read by the worker
+    volatile int exit __attribute__((aligned(EC_CACHELINE)));
+    volatile uint64_t exit_requested_ns; // CLOCK_MONOTONIC when exit was set
+    ec_command_ring_t commands;          // UI to worker, rung via worker_wake_fd
+    // published by the worker
+    ec_stats_t ec_stats;
 }static *share_info = NULL;
 
+// Latest sample and history, also exported read-only to local monitors
+static ec_shm_t* telemetry_shm = NULL;
+
+// Latest sample of the process reading the EC (worker or status mode)
+static ec_telemetry_t latest;
+
+// Fan control state of the process driving the EC
+static int auto_duty = 1;
+static int auto_duty_val = 0; // last duty the controller wrote, 0 forces a write
+static fan_pid_t fan_controller;
+
 static pid_t parent_pid = 0;
+static int worker_wake_fd = -1; // eventfd the UI rings to hand the worker a command
+static pid_t worker_pid = 0;
 static int debug_mode = 0;
+static int stats_mode = 0;
+static int benchmark_iterations = 0;
+static int fan_duty_arg = -1; // first non-option argument
 static int status_mode = 0;
 static int status_interval = 2; // Default 2 seconds
 static int target_temperature = 65; // Default target temperature
+static int slo_ms = EC_LOOP_DEFAULT_SLO_MS; // worker iteration deadline after its tick
+static const char* record_path = NULL;
+static const char* replay_path = NULL;
+static int telemetry_mode = 0;
+static int sysfs_ruled_out = 0;
+static int instance_fd = -1; // single-instance socket, forwarded commands arrive here
+static int daemon_mode = 0;
+static ec_daemon_t daemon_server = { .listen_fd = -1 }; // --daemon: serves the clients
+static int daemon_fd = -1; // client of a running daemon: its subscription
+static ec_trace_writer_t* trace_writer = NULL;
 
 int main(int argc, char* argv[]) {
     printf("Simple fan control utility for Clevo laptops\n");
+    // Startup milestones are measured from here
+    ec_stats_get();
     
     // Parse command line arguments
     parse_command_line(argc, argv);
+    // Let the kernel batch our timers with the rest of the system; the
+    // worker inherits the slack across fork
+    if (ec_power_config()->enabled && ec_power_apply_slack() != EXIT_SUCCESS)
+        printf("unable to set timer slack: %s\n", strerror(errno));
+    if (replay_path != NULL)
+        return main_replay(replay_path);
+    if (telemetry_mode)
+        return main_read_telemetry();
+    // A running daemon owns the EC: be one of its unprivileged clients
+    if (!daemon_mode && backend_type == EC_BACKEND_AUTO && benchmark_iterations == 0
+            && (daemon_fd = ec_client_connect()) >= 0)
+        return main_client(argc, argv);
     
-    if (check_proc_instances(NAME) > 1) {
+    instance_fd = ec_instance_claim();
+    if (instance_fd < 0 && errno == EADDRINUSE) {
+        if (!ec_instance_trusted()) {
+            printf("Instance name is held by another user: %s\n", strerror(errno));
+            return EXIT_FAILURE;
+        }
+        if (fan_duty_arg != -1) {
+            // Let the running instance apply the duty instead of racing it
+            int val = atoi(argv[fan_duty_arg]);
+            if (val < 40 || val > 100) {
+                printf("invalid fan duty %d!\n", val);
+                return EXIT_FAILURE;
+            }
+            if (ec_instance_forward(EC_COMMAND_SET_DUTY, val) == EXIT_SUCCESS) {
+                printf("Running instance set fan duty to %d%%\n", val);
+                return EXIT_SUCCESS;
+            }
+            printf("Running instance refused fan duty %d%%: %s\n", val, strerror(errno));
+            return EXIT_FAILURE;
+        }
         printf("Multiple running instances!\n");
         char* display = getenv("DISPLAY");
         if (display != NULL && strlen(display) > 0) {
@@ -184,40 +286,70 @@ int main(int argc, char* argv[]) {
         }
         return EXIT_FAILURE;
     }
-    // Setup privileges using modern methods
-    if (!setup_privileges()) {
+    // Setup privileges using modern methods; the mock and sim backends need
+    // none and the benchmark reports unavailable backends instead of failing
+    if (backend_type != EC_BACKEND_MOCK && backend_type != EC_BACKEND_SIM
+            && !setup_privileges() && benchmark_iterations == 0) {
         printf("Failed to setup privileges for EC access\n");
         return EXIT_FAILURE;
     }
     
+    if (benchmark_iterations > 0) {
+        ec_backend_benchmark(stdout, benchmark_iterations);
+        return EXIT_SUCCESS;
+    }
+    
+    // A cached port backend means ec_sys could not be used last time: do not
+    // pay for another attempt
+    ec_backend_type_t cached_backend = ec_backend_cached();
+    sysfs_ruled_out = cached_backend == EC_BACKEND_PORT || cached_backend == EC_BACKEND_DEVPORT;
+    if (backend_type == EC_BACKEND_SYSFS || (backend_type == EC_BACKEND_AUTO && !sysfs_ruled_out))
+        ec_prepare_sysfs();
+
     // Test EC access
     if (ec_init() != EXIT_SUCCESS) {
         printf("unable to control EC: %s\n", strerror(errno));
         return EXIT_FAILURE;
     }
+    if (record_path != NULL && (trace_writer = ec_trace_create(record_path)) == NULL) {
+        printf("unable to record to %s: %s\n", record_path, strerror(errno));
+        return EXIT_FAILURE;
+    }
     
+    if (daemon_mode)
+        return main_daemon();
+
     // Handle status mode
     if (status_mode) {
         signal_term(&main_on_sigterm);
+        // Skip a refresh rather than stall behind another EC user
+        ec_lock_set_timeout(EC_LOCK_WORKER_TIMEOUT_MS);
         status_display_init();
         status_display_show_help();
         
         // Initialize shared memory for status mode
         main_init_share();
         
-        // Run status display loop with auto fan control
+        // Run status display loop with auto fan control, applying forwarded
+        // commands as they arrive
         while (1) {
             status_display_update_with_control();
-            usleep(status_interval * 1000000); // Convert to microseconds
-        }
-    }
-    
-    // Find the first non-option argument
-    int fan_duty_arg = -1;
-    for (int i = 1; i < argc; i++) {
-        if (argv[i][0] != '-') {
-            fan_duty_arg = i;
-            break;
+            uint64_t deadline = ec_stats_now_ns() + (uint64_t) status_interval * 1000000000ULL;
+            uint64_t now;
+            while ((now = ec_stats_now_ns()) < deadline) {
+                int fds[EC_INSTANCE_MAX_SENDERS + 1];
+                int count = ec_instance_pending(fds);
+                fds[count++] = instance_fd;
+                struct pollfd polls[EC_INSTANCE_MAX_SENDERS + 1];
+                for (int i = 0; i < count; i++)
+                    polls[i] = (struct pollfd) { .fd = fds[i], .events = POLLIN };
+                if (poll(polls, count, (int) ((deadline - now) / 1000000) + 1) <= 0)
+                    continue;
+                for (int i = 0; i < count; i++) {
+                    if (polls[i].revents != 0)
+                        ec_apply_forwarded_command(polls[i].fd, NULL);
+                }
+            }
         }
     }
     
@@ -229,17 +361,28 @@ int main(int argc, char* argv[]) {
         } else {
             parent_pid = getpid();
             main_init_share();
-            signal(SIGCHLD, &main_on_sigchld);
             signal_term(&main_on_sigterm);
-            pid_t worker_pid = fork();
+            // The worker must never run the UI's handler, which tears down
+            // the shared segment: fork with the signals blocked so they
+            // wait for the worker's loop, and unblock them in the parent
+            sigset_t term_signals, ui_mask;
+            signal_term_set(&term_signals);
+            sigprocmask(SIG_BLOCK, &term_signals, &ui_mask);
+            worker_pid = fork();
+            if (worker_pid != 0)
+                sigprocmask(SIG_SETMASK, &ui_mask, NULL);
             if (worker_pid == 0) {
-                signal(SIGCHLD, SIG_DFL);
-                signal_term(&ec_on_sigterm);
                 return main_ec_worker();
             } else if (worker_pid > 0) {
+                // The worker answers forwarded commands
+                if (instance_fd >= 0)
+                    close(instance_fd);
                 main_ui_worker(argc, argv);
+                share_info->exit_requested_ns = ec_stats_now_ns();
                 share_info->exit = 1;
+                ec_loop_wake(worker_wake_fd);
                 waitpid(worker_pid, NULL, 0);
+                ec_shm_destroy(telemetry_shm);
             } else {
                 printf("unable to create worker: %s\n", strerror(errno));
                 return EXIT_FAILURE;
@@ -258,113 +401,309 @@ int main(int argc, char* argv[]) {
 }
 
 static void main_init_share(void) {
-    void* shm = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_ANON | MAP_SHARED,
-            -1, 0);
+    void* shm = mmap(NULL, sizeof(*share_info), PROT_READ | PROT_WRITE,
+            MAP_ANON | MAP_SHARED, -1, 0);
     share_info = shm;
+    worker_wake_fd = ec_loop_wake_fd();
     share_info->exit = 0;
-    share_info->cpu_temp = 0;
-    share_info->gpu_temp = 0;
-    share_info->fan_duty = 0;
-    share_info->fan_rpms = 0;
-    share_info->auto_duty = 1;
-    share_info->auto_duty_val = 0;
-    share_info->manual_next_fan_duty = 0;
-    share_info->manual_prev_fan_duty = 0;
+    // EC statistics live in the shared page so both processes see them
+    ec_stats_attach(&share_info->ec_stats);
+    telemetry_shm = ec_shm_create();
+    if (telemetry_shm == NULL) {
+        printf("unable to create telemetry segment: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
 }
 
 static int main_ec_worker(void) {
     setuid(0);
-    if (debug_mode) printf("[DEBUG] Worker started, attempting to modprobe ec_sys\n");
-    system("modprobe ec_sys");
-    
-    // Try to determine if sysfs method is available
-    int sysfs_available = 0;
-    int io_fd = open("/sys/kernel/debug/ec/ec0/io", O_RDONLY, 0);
-    if (io_fd >= 0) {
-        sysfs_available = 1;
-        close(io_fd);
-        if (debug_mode) printf("[DEBUG] sysfs method available\n");
-    } else {
-        if (debug_mode) printf("[DEBUG] sysfs method not available, falling back to direct I/O\n");
+    // Changing credentials clears the parent-death signal, so set it after
+    // setuid; SIGTERM then arrives through the loop's signalfd
+    if (parent_pid != 0) {
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        if (getppid() != parent_pid) {
+            // The UI died before we got here
+            ec_worker_shutdown(ec_stats_now_ns());
+            return EXIT_SUCCESS;
+        }
     }
-    
+    if (backend_type == EC_BACKEND_AUTO && ec_backend->type != EC_BACKEND_SYSFS && !sysfs_ruled_out) {
+        // The UI process may have lacked the privileges to load ec_sys;
+        // once it is loaded, prefer it over polling ports
+        ec_prepare_sysfs();
+        ec_backend_t* sysfs_backend = ec_open(EC_BACKEND_SYSFS);
+        if (sysfs_backend != NULL) {
+            ec_backend_close(ec_backend);
+            ec_backend = sysfs_backend;
+            ec_snapshot_reset();
+            ec_backend_remember(EC_BACKEND_SYSFS);
+        }
+    }
+    if (debug_mode) printf("[DEBUG] Worker using %s backend\n", ec_backend_name(ec_backend->type));
+
+    // Termination signals arrive through the loop instead of a handler
+    sigset_t signals;
+    signal_term_set(&signals);
+    ec_loop_t loop;
+    if (ec_loop_open(&loop, worker_wake_fd, &signals) != EXIT_SUCCESS) {
+        printf("unable to start worker loop: %s\n", strerror(errno));
+        ec_backend_close(ec_backend);
+        return EXIT_FAILURE;
+    }
+    // The parent's pidfd turns readable the moment it exits, whatever the cause
+    int parent_pidfd = parent_pid != 0 ? ec_loop_pidfd(parent_pid) : -1;
+    if (parent_pidfd >= 0)
+        ec_loop_add_fd(&loop, parent_pidfd);
+    if (instance_fd >= 0)
+        ec_loop_add_fd(&loop, instance_fd);
+    if (daemon_server.listen_fd >= 0)
+        ec_loop_add_fd(&loop, daemon_server.listen_fd);
+    if (ec_rt_config()->policy != EC_RT_NONE) {
+        if (ec_rt_apply() != EXIT_SUCCESS)
+            printf("unable to enter %s real-time mode: %s\n", ec_rt_name(ec_rt_config()->policy), strerror(errno));
+        else if (debug_mode)
+            printf("[DEBUG] Worker running under %s, memory locked\n", ec_rt_name(ec_rt_config()->policy));
+    }
+    // A busy bus costs one tick, not several seconds of fan control
+    ec_lock_set_timeout(EC_LOCK_WORKER_TIMEOUT_MS);
+    // Periods on the shared tick grid, stretched on battery
+    unsigned int base_period = loop.period_ms;
+    if (ec_power_config()->enabled) {
+        ec_loop_align(&loop, 1);
+        if (debug_mode) printf("[DEBUG] Worker power-aware, %s\n", ec_power_battery(ec_stats_now_ns()) ? "on battery" : "on AC");
+    }
+
+    ec_stats_get()->loop.slo_ms = (uint32_t) slo_ms;
     int loop_count = 0;
+    int prev_temp = -1;
     while (share_info->exit == 0) {
-        if (debug_mode) printf("[DEBUG] Worker loop iteration %d\n", loop_count++);
-        // check parent
-        if (parent_pid != 0 && kill(parent_pid, 0) == -1) {
-            if (debug_mode) printf("[DEBUG] worker on parent death\n");
-            break;
-        }
-        // write EC
-        int new_fan_duty = share_info->manual_next_fan_duty;
-        if (new_fan_duty != 0 && new_fan_duty != share_info->manual_prev_fan_duty) {
-            if (debug_mode) printf("[DEBUG] Writing new fan duty: %d\n", new_fan_duty);
-            int write_result = ec_write_fan_duty(new_fan_duty);
-            if (debug_mode) printf("[DEBUG] ec_write_fan_duty returned: %d\n", write_result);
-            share_info->manual_prev_fan_duty = new_fan_duty;
-        }
+        uint64_t woke_ns = ec_stats_now_ns();
+        // The first iteration is due as soon as the worker is up
+        uint64_t due_ns = loop_count > 0 ? loop.due_ns : woke_ns;
+        uint64_t phase_ns[EC_PHASE_COUNT] = { 0 };
+        uint64_t mark_ns = woke_ns;
+        if (debug_mode) printf("[DEBUG] Worker loop iteration %d (period %u ms)\n", loop_count, loop.period_ms);
+        // apply UI commands in the order they were clicked
+        ec_command_t command;
+        while (ec_command_pop(&share_info->commands, &command))
+            ec_apply_command(&command);
+        mark_ns = worker_phase(phase_ns, EC_PHASE_WRITE, mark_ns);
         
-        // read EC - try sysfs first, fall back to direct I/O
-        if (sysfs_available) {
-            int io_fd = open("/sys/kernel/debug/ec/ec0/io", O_RDONLY, 0);
-            if (io_fd < 0) {
-                if (debug_mode) printf("[DEBUG] sysfs method failed, switching to direct I/O\n");
-                sysfs_available = 0;
-            } else {
-                unsigned char buf[EC_REG_SIZE];
-                ssize_t len = read(io_fd, buf, EC_REG_SIZE);
-                close(io_fd);
-                if (debug_mode) printf("[DEBUG] sysfs read returned len=%ld\n", len);
-                switch (len) {
-                case -1:
-                    if (debug_mode) printf("[DEBUG] unable to read EC from sysfs: %s\n", strerror(errno));
-                    sysfs_available = 0;
-                    break;
-                case 0x100:
-                    share_info->cpu_temp = buf[EC_REG_CPU_TEMP];
-                    share_info->gpu_temp = buf[EC_REG_GPU_TEMP];
-                    share_info->fan_duty = calculate_fan_duty(buf[EC_REG_FAN_DUTY]);
-                    share_info->fan_rpms = calculate_fan_rpms(buf[EC_REG_FAN_RPMS_HI], buf[EC_REG_FAN_RPMS_LO]);
-                    if (debug_mode) printf("[DEBUG] sysfs: cpu_temp=%d, gpu_temp=%d, fan_duty=%d, fan_rpms=%d\n", share_info->cpu_temp, share_info->gpu_temp, share_info->fan_duty, share_info->fan_rpms);
-                    break;
-                default:
-                    if (debug_mode) printf("[DEBUG] wrong EC size from sysfs: %ld\n", len);
-                    sysfs_available = 0;
-                }
+        // read EC
+        ec_sample_t sample;
+        int read_result = ec_query_sample(&sample);
+        if (read_result != EXIT_SUCCESS && backend_type == EC_BACKEND_AUTO
+                && ec_backend->type == EC_BACKEND_SYSFS
+                && ec_backend_health(ec_backend) == EC_HEALTH_FAILED) {
+            // sysfs went away, fall back to direct I/O
+            if (debug_mode) printf("[DEBUG] sysfs method failed, switching to direct I/O\n");
+            ec_backend_t* port_backend = ec_open(EC_BACKEND_PORT);
+            if (port_backend == NULL)
+                port_backend = ec_open(EC_BACKEND_DEVPORT);
+            if (port_backend != NULL) {
+                ec_backend_close(ec_backend);
+                ec_backend = port_backend;
+                ec_snapshot_reset();
+                read_result = ec_query_sample(&sample);
             }
         }
-        
-        // Fall back to direct I/O if sysfs is not available
-        if (!sysfs_available) {
-            if (debug_mode) printf("[DEBUG] Using direct I/O for EC access\n");
-            share_info->cpu_temp = ec_query_cpu_temp();
-            share_info->gpu_temp = ec_query_gpu_temp();
-            share_info->fan_duty = ec_query_fan_duty();
-            share_info->fan_rpms = ec_query_fan_rpms();
-            if (debug_mode) printf("[DEBUG] direct I/O: cpu_temp=%d, gpu_temp=%d, fan_duty=%d, fan_rpms=%d\n", share_info->cpu_temp, share_info->gpu_temp, share_info->fan_duty, share_info->fan_rpms);
+        mark_ns = worker_phase(phase_ns, EC_PHASE_READ, mark_ns);
+        if (read_result == EXIT_SUCCESS) {
+            publish_sample(&sample, woke_ns);
+            trace_record_sample(&sample);
+            mark_ns = worker_phase(phase_ns, EC_PHASE_PUBLISH, mark_ns);
+
+            // Sample fast while heating up or near the target, slowly when idle
+            int temp = MAX(sample.cpu_temp, sample.gpu_temp);
+            base_period = ec_loop_adapt_period(base_period, temp,
+                    prev_temp >= 0 ? prev_temp : temp, target_temperature);
+            ec_loop_set_period(&loop, ec_power_config()->enabled
+                    ? ec_power_period(base_period, ec_power_battery(woke_ns)) : base_period);
+            // Slow drifts add up until they count as a trend
+            if (prev_temp < 0 || abs(temp - prev_temp) >= EC_LOOP_TREND_C)
+                prev_temp = temp;
+            mark_ns = worker_phase(phase_ns, EC_PHASE_CONTROL, mark_ns);
+        }
+        if (debug_mode) {
+            const ec_op_stats_t* batch = &ec_stats_get()->ops[EC_OP_BATCH];
+            printf("[DEBUG] %s: cpu_temp=%d, gpu_temp=%d, fan_duty=%d, fan_rpms=%d\n",
+                    ec_backend_name(ec_backend->type), latest.cpu_temp, latest.gpu_temp,
+                    latest.fan_duty, latest.fan_rpms);
+            for (int i = 0; i < ec_extra_reg_count; i++)
+                printf("[DEBUG] EC reg 0x%02X = 0x%02X\n", ec_extra_regs[i], ec_extra_values[i]);
+            printf("[DEBUG] EC batch: %llu regs in %llu us (max %llu us over %llu batches)\n",
+                    (unsigned long long) (EC_SAMPLE_REG_COUNT + ec_extra_reg_count),
+                    (unsigned long long) (batch->last_ns / 1000),
+                    (unsigned long long) (batch->latency.max_ns / 1000),
+                    (unsigned long long) batch->calls);
+            mark_ns = worker_phase(phase_ns, EC_PHASE_PUBLISH, mark_ns);
         }
         
+        // full register sweep, a budgeted chunk per tick
+        if (ec_snapshot_budget_us() > 0 && ec_snapshot_step(ec_backend) == 1 && debug_mode) {
+            uint32_t generation = 0;
+            ec_snapshot_get(&generation, NULL);
+            printf("[DEBUG] EC snapshot #%u published (sweep %llu ms)\n", generation,
+                    (unsigned long long) (ec_stats_get()->snapshot_sweep.total_ns
+                            / ec_stats_get()->snapshots / 1000000));
+        }
+        mark_ns = worker_phase(phase_ns, EC_PHASE_READ, mark_ns);
+
         // auto EC
-        if (share_info->auto_duty == 1) {
-            int next_duty = ec_auto_duty_adjust();
-            if (debug_mode) printf("[DEBUG] auto_duty=1, next_duty=%d, prev_auto_duty_val=%d\n", next_duty, share_info->auto_duty_val);
-            if (next_duty != 0 && next_duty != share_info->auto_duty_val) {
+        if (auto_duty == 1) {
+            int next_duty = ec_auto_duty_adjust(ec_sample_clock_ns());
+            if (debug_mode) printf("[DEBUG] auto_duty=1, next_duty=%d, prev_auto_duty_val=%d\n", next_duty, auto_duty_val);
+            mark_ns = worker_phase(phase_ns, EC_PHASE_CONTROL, mark_ns);
+            if (next_duty != 0 && next_duty != auto_duty_val) {
                 char s_time[256];
                 get_time_string(s_time, 256, "%m/%d %H:%M:%S");
-                printf("%s CPU=%d°C, GPU=%d°C, auto fan duty to %d%%\n", s_time, share_info->cpu_temp, share_info->gpu_temp, next_duty);
+                printf("%s CPU=%d°C, GPU=%d°C, auto fan duty to %d%%\n", s_time, latest.cpu_temp, latest.gpu_temp, next_duty);
                 int write_result = ec_write_fan_duty(next_duty);
                 if (debug_mode) printf("[DEBUG] ec_write_fan_duty (auto) returned: %d\n", write_result);
-                share_info->auto_duty_val = next_duty;
+                auto_duty_val = next_duty;
             }
+            mark_ns = worker_phase(phase_ns, EC_PHASE_WRITE, mark_ns);
+        }
+        ec_stats_record_iteration(due_ns, mark_ns, phase_ns);
+        ec_stats_get()->power.worker_cpu_ns = ec_power_cpu_ns();
+        loop_count++;
+        if ((debug_mode || stats_mode) && loop_count % 300 == 0) {
+            ec_stats_print(stdout, ec_stats_get());
         }
-        //
-        usleep(200 * 1000);
+
+        if (!ec_worker_wait(&loop, parent_pidfd))
+            break;
     }
-    if (debug_mode) printf("[DEBUG] Worker quit (share_info->exit=%d)\n", share_info->exit);
+    // A UI-requested exit is timed from the request, anything else from now
+    uint64_t requested_ns = share_info->exit ? share_info->exit_requested_ns : 0;
+    ec_worker_shutdown(requested_ns != 0 ? requested_ns : ec_stats_now_ns());
+    if (parent_pidfd >= 0)
+        close(parent_pidfd);
+    ec_loop_close(&loop);
     return EXIT_SUCCESS;
 }
 
+// Charge the time since `since_ns` to a phase of the current iteration;
+// returns now, the start of the next phase
+static uint64_t worker_phase(uint64_t* phase_ns, ec_phase_t phase, uint64_t since_ns) {
+    uint64_t now = ec_stats_now_ns();
+    phase_ns[phase] += now - since_ns;
+    return now;
+}
+
+// Returns EXIT_SUCCESS, or EXIT_FAILURE with errno set if the command was
+// invalid (EINVAL) or the EC write failed
+static int ec_apply_command(const ec_command_t* command) {
+    if (debug_mode) printf("[DEBUG] Command: %s %d\n", ec_command_name(command->type), command->value);
+    int result = EXIT_SUCCESS;
+    switch (command->type) {
+        case EC_COMMAND_SET_DUTY:
+            auto_duty = 0;
+            auto_duty_val = 0;
+            result = ec_write_fan_duty(command->value);
+            break;
+        case EC_COMMAND_SET_AUTO:
+            auto_duty = 1;
+            auto_duty_val = 0;
+            fan_pid_reset(&fan_controller); // take over from the manual duty
+            break;
+        case EC_COMMAND_SET_TARGET:
+            if (command->value >= 40 && command->value <= 100) {
+                target_temperature = command->value;
+            } else {
+                errno = EINVAL;
+                result = EXIT_FAILURE;
+            }
+            break;
+        default:
+            errno = EINVAL;
+            result = EXIT_FAILURE;
+            break;
+    }
+    ec_command_stats_t* stats = &ec_stats_get()->commands;
+    stats->applied++;
+    ec_histogram_record(&stats->latency, ec_stats_now_ns() - command->issued_ns);
+    return result;
+}
+
+// Apply a command sent by a second `clevo-indicator` invocation; 1 if one
+// was applied. fd is the instance socket, where a new sender is accepted,
+// or a sender accepted earlier. A sender that has not written yet is
+// left to the loop (when there is one) rather than waited for.
+static int ec_apply_forwarded_command(int fd, ec_loop_t* loop) {
+    int accepted = 0;
+    if (fd == instance_fd) {
+        fd = ec_instance_accept(instance_fd);
+        if (fd < 0)
+            return 0;
+        accepted = 1;
+    }
+    ec_command_t command;
+    int served = ec_instance_serve(fd, &command);
+    if (served == 0 && accepted && loop != NULL)
+        ec_loop_add_fd(loop, fd);
+    if (served != 1)
+        return 0;
+    if (debug_mode) printf("[DEBUG] Forwarded command from another instance\n");
+    ec_apply_command(&command);
+    return 1;
+}
+
+// Sleep until the next tick is due: the period elapsed, the UI rang, or a
+// command arrived. Daemon clients asking for snapshots or subscriptions
+// are served from the latest sample without touching the EC. Returns 0
+// when the worker should stop.
+static int ec_worker_wait(ec_loop_t* loop, int parent_pidfd) {
+    for (;;) {
+        int events = ec_loop_wait(loop);
+        if (events < 0 || (events & EC_LOOP_SIGNAL)) {
+            if (debug_mode) printf("[DEBUG] worker on signal: %s\n", events < 0 ? strerror(errno) : strsignal(loop->last_signal));
+            return 0;
+        }
+        int tick = (events & (EC_LOOP_TIMER | EC_LOOP_WAKE)) != 0;
+        for (int i = 0; i < loop->ready_count; i++) {
+            int fd = loop->ready_fds[i];
+            if (fd == parent_pidfd) {
+                if (debug_mode) printf("[DEBUG] worker on parent death\n");
+                return 0;
+            } else if (fd == instance_fd) {
+                tick |= ec_apply_forwarded_command(fd, loop);
+            } else if (fd == daemon_server.listen_fd) {
+                int client_fd = ec_daemon_accept(&daemon_server);
+                if (client_fd >= 0)
+                    ec_loop_add_fd(loop, client_fd);
+            } else {
+                // A forwarding sender or a daemon client; each ignores the other's
+                tick |= ec_apply_forwarded_command(fd, loop);
+                ec_command_t command;
+                if (ec_daemon_serve(&daemon_server, fd, &latest, &command) == EC_MSG_COMMAND) {
+                    errno = 0;
+                    int result = ec_apply_command(&command);
+                    // Backends do not all set errno on a failed EC write
+                    ec_daemon_reply(fd, result == EXIT_SUCCESS ? 0 : errno != 0 ? errno : EIO);
+                    tick = 1;
+                }
+            }
+        }
+        if (tick)
+            return 1;
+    }
+}
+
+// Leave the fan in a safe state and release the EC
+static void ec_worker_shutdown(uint64_t requested_ns) {
+    int duty = latest.fan_duty;
+    if (duty < SAFE_FAN_DUTY) {
+        if (debug_mode) printf("[DEBUG] Worker exit: fan duty %d%% -> %d%%\n", duty, SAFE_FAN_DUTY);
+        ec_write_fan_duty(SAFE_FAN_DUTY);
+    }
+    ec_stats_get()->loop.teardown_ns = ec_stats_now_ns() - requested_ns;
+    if (debug_mode) printf("[DEBUG] Worker quit (share_info->exit=%d)\n", share_info->exit);
+    if (debug_mode || stats_mode) ec_stats_print(stdout, ec_stats_get());
+    ec_trace_close(trace_writer);
+    ec_backend_close(ec_backend);
+}
+
 static void main_ui_worker(int argc, char** argv) {
     if (debug_mode) printf("Indicator...\n");
     int desktop_uid = getuid();
@@ -396,8 +735,23 @@ static void main_ui_worker(int argc, char** argv) {
     app_indicator_set_ordering_index(indicator, -2);
     app_indicator_set_title(indicator, "Clevo");
     app_indicator_set_menu(indicator, GTK_MENU(indicator_menu));
-    g_timeout_add(500, &ui_update, NULL);
-    ui_toggle_menuitems(share_info->fan_duty);
+    ui_schedule_update();
+    if (daemon_fd >= 0) {
+        // Samples are pushed by the daemon; quit when it goes away
+        g_unix_fd_add(daemon_fd, G_IO_IN | G_IO_HUP | G_IO_ERR, &main_on_daemon_sample, NULL);
+    } else {
+        // Quit with the worker: a pidfd in the main loop where the kernel
+        // has one, SIGCHLD otherwise
+        int worker_pidfd = ec_loop_pidfd(worker_pid);
+        if (worker_pidfd >= 0) {
+            g_unix_fd_add(worker_pidfd, G_IO_IN, &main_on_worker_exit, NULL);
+        } else {
+            signal(SIGCHLD, &main_on_sigchld);
+        }
+    }
+    ec_telemetry_t sample;
+    ui_current_sample(&sample);
+    ui_toggle_menuitems(sample.fan_duty);
     gtk_main();
     if (debug_mode) printf("main on UI quit\n");
 }
@@ -407,22 +761,235 @@ static void main_on_sigchld(int signum) {
     exit(EXIT_SUCCESS);
 }
 
+static gboolean main_on_worker_exit(gint fd, GIOCondition condition, gpointer user_data) {
+    if (debug_mode) printf("main on worker quit\n");
+    close(fd);
+    gtk_main_quit();
+    return FALSE;
+}
+
+static gboolean main_on_daemon_sample(gint fd, GIOCondition condition, gpointer user_data) {
+    if (ec_client_next(fd, &latest) == EXIT_SUCCESS)
+        return G_SOURCE_CONTINUE;
+    if (debug_mode) printf("main on daemon quit\n");
+    gtk_main_quit();
+    return G_SOURCE_REMOVE;
+}
+
 static void main_on_sigterm(int signum) {
     if (debug_mode) printf("main on signal: %s\n", strsignal(signum));
     if (status_mode) {
         status_display_cleanup();
+        ec_trace_close(trace_writer);
     }
-    if (share_info != NULL)
+    if (share_info != NULL) {
+        share_info->exit_requested_ns = ec_stats_now_ns();
         share_info->exit = 1;
+    }
+    ec_loop_wake(worker_wake_fd);
+    ec_shm_destroy(telemetry_shm);
     exit(EXIT_SUCCESS);
 }
 
 static int main_dump_fan(void) {
+    ec_sample_t sample;
+    if (ec_query_sample(&sample) != EXIT_SUCCESS) {
+        printf("unable to read fan information from the EC\n");
+        if (debug_mode || stats_mode) ec_stats_print(stdout, ec_stats_get());
+        return EXIT_FAILURE;
+    }
     printf("Dump fan information\n");
-    printf("  FAN Duty: %d%%\n", ec_query_fan_duty());
-    printf("  FAN RPMs: %d RPM\n", ec_query_fan_rpms());
-    printf("  CPU Temp: %d°C\n", ec_query_cpu_temp());
-    printf("  GPU Temp: %d°C\n", ec_query_gpu_temp());
+    printf("  FAN Duty: %d%%\n", sample.fan_duty);
+    printf("  FAN RPMs: %d RPM\n", sample.fan_rpms);
+    printf("  CPU Temp: %d°C\n", sample.cpu_temp);
+    printf("  GPU Temp: %d°C\n", sample.gpu_temp);
+    for (int i = 0; i < ec_extra_reg_count; i++)
+        printf("  Reg 0x%02X: 0x%02X\n", ec_extra_regs[i], ec_extra_values[i]);
+    if (debug_mode) {
+        uint8_t regs[EC_REG_SIZE];
+        if (ec_backend_snapshot(ec_backend, regs) == EXIT_SUCCESS) {
+            printf("EC registers:\n");
+            for (int row = 0; row < EC_REG_SIZE; row += 16) {
+                printf("  %02X:", row);
+                for (int col = 0; col < 16; col++)
+                    printf(" %02X", regs[row + col]);
+                printf("\n");
+            }
+        }
+    }
+    if (debug_mode || stats_mode) ec_stats_print(stdout, ec_stats_get());
+    return EXIT_SUCCESS;
+}
+
+// Own the EC on behalf of every other invocation: the worker loop, plus a
+// socket serving snapshots, subscriptions and commands
+static int main_daemon(void) {
+    if (ec_daemon_listen(&daemon_server) != EXIT_SUCCESS) {
+        printf("unable to listen on %s: %s\n", EC_DAEMON_SOCKET_PATH, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    main_init_share();
+    printf("Serving clients on %s\n", EC_DAEMON_SOCKET_PATH);
+    int result = main_ec_worker();
+    ec_daemon_close(&daemon_server);
+    ec_shm_destroy(telemetry_shm);
+    return result;
+}
+
+// A daemon owns the EC: run this invocation through it, unprivileged
+static int main_client(int argc, char** argv) {
+    int desktop_uid = getuid();
+    setuid(desktop_uid);
+    if (debug_mode) printf("[DEBUG] Client of the daemon at %s\n", EC_DAEMON_SOCKET_PATH);
+    if (status_mode)
+        return main_client_status();
+    if (fan_duty_arg != -1) {
+        int val = atoi(argv[fan_duty_arg]);
+        if (val < 40 || val > 100) {
+            printf("invalid fan duty %d!\n", val);
+            return EXIT_FAILURE;
+        }
+        if (ec_client_command(EC_COMMAND_SET_DUTY, val) != EXIT_SUCCESS) {
+            printf("daemon refused fan duty %d%%: %s\n", val, strerror(errno));
+            return EXIT_FAILURE;
+        }
+        printf("Change fan duty to %d%%\n", val);
+        return EXIT_SUCCESS;
+    }
+    char* display = getenv("DISPLAY");
+    if (display == NULL || strlen(display) == 0) {
+        ec_telemetry_t sample;
+        if (ec_client_snapshot(daemon_fd, &sample) != EXIT_SUCCESS) {
+            printf("daemon did not answer: %s\n", strerror(errno));
+            return EXIT_FAILURE;
+        }
+        printf("Dump fan information\n");
+        printf("  FAN Duty: %d%%\n", sample.fan_duty);
+        printf("  FAN RPMs: %d RPM\n", sample.fan_rpms);
+        printf("  CPU Temp: %d°C\n", sample.cpu_temp);
+        printf("  GPU Temp: %d°C\n", sample.gpu_temp);
+        return EXIT_SUCCESS;
+    }
+    if (ec_client_subscribe(daemon_fd) != EXIT_SUCCESS) {
+        printf("daemon did not answer: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    main_ui_worker(argc, argv);
+    return EXIT_SUCCESS;
+}
+
+// Live status from the daemon's pushed samples, redrawn every interval
+static int main_client_status(void) {
+    signal_term(&main_on_sigterm);
+    status_display_init();
+    status_display_show_help();
+    // The trend comes from the daemon's exported history
+    const ec_shm_t* shm = ec_shm_attach();
+    if (ec_client_subscribe(daemon_fd) != EXIT_SUCCESS) {
+        status_display_cleanup();
+        printf("daemon did not answer: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    uint64_t next_render_ns = 0;
+    while (ec_client_next(daemon_fd, &latest) == EXIT_SUCCESS) {
+        uint64_t now = ec_stats_now_ns();
+        if (now < next_render_ns)
+            continue;
+        next_render_ns = now + (uint64_t) status_interval * 1000000000ULL;
+        status_display_render(shm != NULL ? &shm->history : NULL);
+    }
+    status_display_cleanup();
+    ec_shm_detach(shm);
+    printf("daemon went away\n");
+    return EXIT_FAILURE;
+}
+
+// Read the running instance's exported telemetry the way any local monitor
+// would: no EC access and no privileges needed
+static int main_read_telemetry(void) {
+    const ec_shm_t* shm = ec_shm_attach();
+    if (shm == NULL) {
+        printf("no running instance to read telemetry from: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    ec_telemetry_t sample;
+    ec_telemetry_read(&shm->telemetry, &sample);
+    printf("Telemetry of pid %d (sample #%llu, %.1f s old)\n", shm->header.writer_pid,
+            (unsigned long long) sample.sequence,
+            sample.sequence > 0 ? (double) (ec_stats_now_ns() - sample.sampled_ns) / 1e9 : 0.0);
+    printf("  FAN Duty: %d%% (commanded %d%%)\n", sample.fan_duty, sample.commanded_duty);
+    printf("  FAN RPMs: %d RPM\n", sample.fan_rpms);
+    printf("  CPU Temp: %d°C\n", sample.cpu_temp);
+    printf("  GPU Temp: %d°C\n", sample.gpu_temp);
+    printf("  Loop latency: %d us\n", sample.loop_latency_us);
+    double trend;
+    uint64_t span_ns;
+    if (ec_history_temp_rate(&shm->history, 60ULL * 1000000000ULL, &trend, &span_ns) == EXIT_SUCCESS)
+        printf("  Trend: %+.1f°C/min over %.0f s\n", trend, (double) span_ns / 1e9);
+    ec_shm_detach(shm);
+    return EXIT_SUCCESS;
+}
+
+// Feed a recorded trace through the controller as fast as possible. The
+// replay is open loop: the recorded temperatures do not react to the
+// duties the controller picks, so compare decisions, not outcomes.
+static int main_replay(const char* path) {
+    ec_trace_t trace;
+    if (ec_trace_map(path, &trace) != EXIT_SUCCESS) {
+        printf("unable to read trace %s: %s\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    uint64_t start = ec_stats_now_ns();
+    size_t samples = 0;
+    size_t recorded_writes = 0;
+    size_t controller_writes = 0;
+    int max_temp = 0;
+    uint64_t above_target_ns = 0;
+    uint64_t last_t_ns = 0;
+    int above_target = 0;
+    for (size_t i = 0; i < trace.count; i++) {
+        const ec_trace_record_t* record = &trace.records[i];
+        if (record->kind == EC_TRACE_DUTY_WRITE) {
+            recorded_writes++;
+            continue;
+        }
+        if (record->kind != EC_TRACE_SAMPLE)
+            continue;
+        if (samples > 0 && above_target)
+            above_target_ns += record->t_ns - last_t_ns;
+        last_t_ns = record->t_ns;
+        samples++;
+
+        latest.cpu_temp = record->cpu_temp;
+        latest.gpu_temp = record->gpu_temp;
+        latest.fan_duty = record->fan_duty;
+        latest.fan_rpms = record->fan_rpms;
+        int temp = MAX(record->cpu_temp, record->gpu_temp);
+        max_temp = MAX(max_temp, temp);
+        above_target = temp >= target_temperature;
+
+        int next_duty = ec_auto_duty_adjust(record->t_ns);
+        if (next_duty != 0 && next_duty != auto_duty_val) {
+            controller_writes++;
+            auto_duty_val = next_duty;
+        }
+    }
+    double elapsed_ms = (double) (ec_stats_now_ns() - start) / 1e6;
+    double minutes = (double) last_t_ns / 60e9;
+    printf("Replayed %zu samples (%.1f min of trace) in %.3f ms\n", samples, minutes, elapsed_ms);
+    printf("  Duty writes: %zu controller (%.1f/min), %zu recorded (%.1f/min)\n",
+            controller_writes, minutes > 0 ? controller_writes / minutes : 0.0,
+            recorded_writes, minutes > 0 ? recorded_writes / minutes : 0.0);
+    printf("  Peak temperature: %d°C, %.1f%% of the time at or above the %d°C target\n",
+            max_temp, last_t_ns > 0 ? 100.0 * (double) above_target_ns / (double) last_t_ns : 0.0,
+            target_temperature);
+    const ec_controller_stats_t* controller = &ec_stats_get()->controller;
+    printf("  Controller: %llu excursions, %llu settled (median %.1f s), overshoot max %d°C\n",
+            (unsigned long long) controller->excursions,
+            (unsigned long long) controller->settled,
+            (double) ec_histogram_percentile(&controller->settling, 50.0) / 1e9,
+            controller->max_overshoot_c);
+    ec_trace_unmap(&trace);
     return EXIT_SUCCESS;
 }
 
@@ -434,30 +1001,58 @@ static int main_test_fan(int duty_percentage) {
     return EXIT_SUCCESS;
 }
 
+// Latest sample from the worker, or as pushed by the daemon
+static void ui_current_sample(ec_telemetry_t* sample) {
+    if (daemon_fd >= 0)
+        *sample = latest;
+    else
+        ec_telemetry_read(&telemetry_shm->telemetry, sample);
+}
+
+// Arm the next label refresh; in power-aware mode on the worker's tick
+// grid, and less often on battery
+static void ui_schedule_update(void) {
+    if (!ec_power_config()->enabled) {
+        g_timeout_add(UI_UPDATE_MS, &ui_update, NULL);
+        return;
+    }
+    unsigned int period_ms = ec_power_period(UI_UPDATE_MS, ec_power_battery(ec_stats_now_ns()));
+    g_timeout_add(ec_power_delay_ms(period_ms), &ui_update, NULL);
+}
+
 static gboolean ui_update(gpointer user_data) {
+    ec_power_stats_t* power = &ec_stats_get()->power;
+    power->ui_wakeups++;
+    power->ui_cpu_ns = ec_power_cpu_ns();
+    ec_telemetry_t sample;
+    ui_current_sample(&sample);
     char label[256];
-    sprintf(label, "%d℃ %d℃", share_info->cpu_temp, share_info->gpu_temp);
+    sprintf(label, "%d℃ %d℃", sample.cpu_temp, sample.gpu_temp);
     app_indicator_set_label(indicator, label, "XXXXXX");
     char icon_name[256];
-    double load = ((double) share_info->fan_rpms) / MAX_FAN_RPM * 100.0;
+    double load = ((double) sample.fan_rpms) / MAX_FAN_RPM * 100.0;
     double load_r = round(load / 5.0) * 5.0;
     sprintf(icon_name, "brasero-disc-%02d", (int) load_r);
     app_indicator_set_icon(indicator, icon_name);
-    return G_SOURCE_CONTINUE;
+    if (!ec_power_config()->enabled)
+        return G_SOURCE_CONTINUE;
+    // A one-shot timeout re-aligned every time, so it cannot drift off the grid
+    ui_schedule_update();
+    return G_SOURCE_REMOVE;
 }
 
 static void ui_command_set_fan(long fan_duty) {
     int fan_duty_val = (int) fan_duty;
-    if (fan_duty_val == 0) {
-        if (debug_mode) printf("clicked on fan duty auto\n");
-        share_info->auto_duty = 1;
-        share_info->auto_duty_val = 0;
-        share_info->manual_next_fan_duty = 0;
+    ec_command_type_t type = fan_duty_val == 0 ? EC_COMMAND_SET_AUTO : EC_COMMAND_SET_DUTY;
+    if (debug_mode) printf("clicked on fan duty: %d\n", fan_duty_val);
+    if (daemon_fd >= 0) {
+        if (ec_client_command(type, fan_duty_val) != EXIT_SUCCESS) {
+            printf("daemon refused %s: %s\n", ec_command_name(type), strerror(errno));
+            return;
+        }
     } else {
-        if (debug_mode) printf("clicked on fan duty: %d\n", fan_duty_val);
-        share_info->auto_duty = 0;
-        share_info->auto_duty_val = 0;
-        share_info->manual_next_fan_duty = fan_duty_val;
+        ec_command_push(&share_info->commands, type, fan_duty_val);
+        ec_loop_wake(worker_wake_fd);
     }
     ui_toggle_menuitems(fan_duty_val);
 }
@@ -481,118 +1076,147 @@ static void ui_toggle_menuitems(int fan_duty) {
     }
 }
 
-static int ec_init(void) {
-    if (ioperm(EC_DATA, 1, 1) != 0)
-        return EXIT_FAILURE;
-    if (ioperm(EC_SC, 1, 1) != 0)
-        return EXIT_FAILURE;
-    return EXIT_SUCCESS;
+// Every consumer goes through the shadow register cache
+static ec_backend_t* ec_open(ec_backend_type_t type) {
+    return ec_cache_open(ec_backend_open(type));
 }
 
-static void ec_on_sigterm(int signum) {
-    if (debug_mode) printf("ec on signal: %s\n", strsignal(signum));
-    if (share_info != NULL)
-        share_info->exit = 1;
+static void ec_prepare_sysfs(void) {
+    uint64_t start = ec_stats_now_ns();
+    int result = ec_sysfs_load_module();
+    uint64_t elapsed = ec_stats_now_ns() - start;
+    ec_stats_get()->startup.module_load_ns += elapsed;
+    if (debug_mode) printf("[DEBUG] ec_sys %s after %llu us\n", result == EXIT_SUCCESS ? "loaded" : "unavailable",
+            (unsigned long long) (elapsed / 1000));
 }
 
-static int ec_auto_duty_adjust(void) {
-    int temp = MAX(share_info->cpu_temp, share_info->gpu_temp);
-    int duty = share_info->fan_duty;
-    int new_duty = duty;
-
-    if (temp >= target_temperature) {
-        // Gradually increase fan duty cycle to find steady state
-        new_duty = MAX(duty + 2, 10);
-    }
-    else {
-        // Decrease fan duty cycle if temperature is below target
-        new_duty = MAX(duty - 2, 0);
+static int ec_init(void) {
+    ec_backend = ec_open(backend_type);
+    if (ec_backend == NULL)
+        return EXIT_FAILURE;
+    if (debug_mode) printf("[DEBUG] EC backend: %s\n", ec_backend_name(ec_backend->type));
+    if (debug_mode && (ec_backend->type == EC_BACKEND_PORT || ec_backend->type == EC_BACKEND_DEVPORT)) {
+        ec_wait_config_t* wait_config = ec_port_wait_config();
+        printf("[DEBUG] inb takes %llu ns, spinning %u polls (%u us) before sleeping\n",
+                (unsigned long long) wait_config->inb_ns, wait_config->spin_iterations, wait_config->spin_us);
     }
+    return EXIT_SUCCESS;
+}
 
-    if (new_duty > 100) {
-        new_duty = 100;
-    } else if (new_duty < 0) {
-        new_duty = 0;
-    }
 
-    // printf("Auto duty adjust: %d -> %d\n", duty, new_duty);
+// When the latest sample was taken on the plant's clock. The simulator
+// runs --sim-speed times faster than the wall clock, and the controller's
+// integral, derivative and slew limits must follow the plant.
+static uint64_t ec_sample_clock_ns(void) {
+    uint64_t now_ns = latest.sampled_ns;
+    if (ec_backend != NULL && ec_backend->type == EC_BACKEND_SIM)
+        ec_sim_state(ec_cache_inner(ec_backend), &now_ns, NULL, NULL, NULL);
+    return now_ns;
+}
 
-    return new_duty;
+// Next duty from the PID controller for the latest sample, taken at now_ns
+static int ec_auto_duty_adjust(uint64_t now_ns) {
+    int temp = MAX(latest.cpu_temp, latest.gpu_temp);
+    return fan_pid_update(&fan_controller, temp, target_temperature, latest.fan_duty, now_ns);
 }
 
 
 
-static int ec_query_cpu_temp(void) {
-    return ec_io_read(EC_REG_CPU_TEMP);
+static void ec_sample_from_regs(const uint8_t* regs, ec_sample_t* sample) {
+    sample->cpu_temp = regs[0];
+    sample->gpu_temp = regs[1];
+    sample->fan_duty = calculate_fan_duty(regs[2]);
+    sample->fan_rpms = calculate_fan_rpms(regs[3], regs[4]);
 }
 
-static int ec_query_gpu_temp(void) {
-    return ec_io_read(EC_REG_GPU_TEMP);
-}
+static int ec_query_sample(ec_sample_t* sample) {
+    uint8_t regs[EC_SAMPLE_REG_COUNT + EC_EXTRA_REG_MAX];
+    uint8_t values[EC_SAMPLE_REG_COUNT + EC_EXTRA_REG_MAX];
+    size_t n = EC_SAMPLE_REG_COUNT;
+    memcpy(regs, ec_sample_regs, EC_SAMPLE_REG_COUNT);
+    // Extra registers come from the sweep once one has completed, keeping
+    // the control loop down to the registers it actually needs
+    const uint8_t* snapshot = ec_snapshot_budget_us() > 0 ? ec_snapshot_get(NULL, NULL) : NULL;
+    if (snapshot == NULL) {
+        memcpy(regs + n, ec_extra_regs, ec_extra_reg_count);
+        n += ec_extra_reg_count;
+    }
 
-static int ec_query_fan_duty(void) {
-    int raw_duty = ec_io_read(EC_REG_FAN_DUTY);
-    return calculate_fan_duty(raw_duty);
+    // A failed batch may stop part way and leave the rest of values unset
+    int result = ec_read_registers(regs, values, n);
+    if (result != EXIT_SUCCESS)
+        return result;
+    ec_sample_from_regs(values, sample);
+    for (int i = 0; i < ec_extra_reg_count; i++)
+        ec_extra_values[i] = snapshot != NULL ? snapshot[ec_extra_regs[i]] : values[EC_SAMPLE_REG_COUNT + i];
+    return result;
 }
 
-static int ec_query_fan_rpms(void) {
-    int raw_rpm_hi = ec_io_read(EC_REG_FAN_RPMS_HI);
-    int raw_rpm_lo = ec_io_read(EC_REG_FAN_RPMS_LO);
-    return calculate_fan_rpms(raw_rpm_hi, raw_rpm_lo);
+// Read a set of registers back-to-back so callers get a single snapshot per
+// tick instead of interleaving other work between individual queries.
+static int ec_read_registers(const uint8_t* regs, uint8_t* out, size_t n) {
+    return ec_backend_read_batch(ec_backend, regs, out, n);
 }
 
 static int ec_write_fan_duty(int duty_percentage) {
     if (duty_percentage < 1 || duty_percentage > 100) {
         printf("Wrong fan duty to write: %d\n", duty_percentage);
+        errno = EINVAL;
         return EXIT_FAILURE;
     }
-    double v_d = ((double) duty_percentage) / 100.0 * 255.0;
-    int v_i = (int) v_d;
-    return ec_io_do(0x99, 0x01, v_i);
-}
-
-static int ec_io_wait(const uint32_t port, const uint32_t flag,
-        const char value) {
-    uint8_t data = inb(port);
-    int i = 0;
-    while ((((data >> flag) & 0x1) != value) && (i++ < 100)) {
-        usleep(1000);
-        data = inb(port);
+    // Round up so calculate_fan_duty() reads back the same percentage and
+    // the write pipeline can recognise an unchanged duty by its raw value
+    int v_i = (duty_percentage * 255 + 99) / 100;
+    int result = ec_backend_write(ec_backend, EC_CMD_FAN_DUTY, EC_FAN_DUTY_PORT, v_i);
+    if (result == EXIT_SUCCESS) {
+        latest.commanded_duty = duty_percentage;
+        ec_startup_stats_t* startup = &ec_stats_get()->startup;
+        if (startup->first_write_ns == 0)
+            startup->first_write_ns = ec_stats_now_ns() - ec_stats_get()->started_ns;
     }
-    if (i >= 100) {
-        printf("wait_ec error on port 0x%x, data=0x%x, flag=0x%x, value=0x%x\n",
-                port, data, flag, value);
-        return EXIT_FAILURE;
+    if (trace_writer != NULL) {
+        ec_trace_record_t record = {
+                .kind = EC_TRACE_DUTY_WRITE,
+                .fan_duty = (uint8_t) duty_percentage,
+                .status = (uint8_t) result
+        };
+        ec_trace_append(trace_writer, &record);
     }
-    return EXIT_SUCCESS;
+    return result;
 }
 
-static uint8_t ec_io_read(const uint32_t port) {
-    ec_io_wait(EC_SC, IBF, 0);
-    outb(EC_SC_READ_CMD, EC_SC);
-
-    ec_io_wait(EC_SC, IBF, 0);
-    outb(port, EC_DATA);
-
-    //wait_ec(EC_SC, EC_SC_IBF_FREE);
-    ec_io_wait(EC_SC, OBF, 1);
-    uint8_t value = inb(EC_DATA);
-
-    return value;
+static void publish_sample(const ec_sample_t* sample, uint64_t woke_ns) {
+    latest.sequence++;
+    latest.sampled_ns = ec_stats_now_ns();
+    latest.loop_latency_us = (int32_t) ((latest.sampled_ns - woke_ns) / 1000);
+    ec_startup_stats_t* startup = &ec_stats_get()->startup;
+    if (startup->first_sample_ns == 0) {
+        startup->first_sample_ns = latest.sampled_ns - ec_stats_get()->started_ns;
+        if (debug_mode) printf("[DEBUG] first sample %.1f ms after start\n", (double) startup->first_sample_ns / 1e6);
+    }
+    latest.cpu_temp = sample->cpu_temp;
+    latest.gpu_temp = sample->gpu_temp;
+    latest.fan_duty = sample->fan_duty;
+    latest.fan_rpms = sample->fan_rpms;
+    if (telemetry_shm != NULL) {
+        ec_telemetry_publish(&telemetry_shm->telemetry, &latest);
+        ec_history_append(&telemetry_shm->history, &latest);
+    }
+    if (daemon_server.listen_fd >= 0)
+        ec_daemon_broadcast(&daemon_server, &latest);
 }
 
-static int ec_io_do(const uint32_t cmd, const uint32_t port,
-        const uint8_t value) {
-    ec_io_wait(EC_SC, IBF, 0);
-    outb(cmd, EC_SC);
-
-    ec_io_wait(EC_SC, IBF, 0);
-    outb(port, EC_DATA);
-
-    ec_io_wait(EC_SC, IBF, 0);
-    outb(value, EC_DATA);
-
-    return ec_io_wait(EC_SC, IBF, 0);
+static void trace_record_sample(const ec_sample_t* sample) {
+    if (trace_writer == NULL)
+        return;
+    ec_trace_record_t record = {
+            .kind = EC_TRACE_SAMPLE,
+            .cpu_temp = (uint8_t) sample->cpu_temp,
+            .gpu_temp = (uint8_t) sample->gpu_temp,
+            .fan_duty = (uint8_t) sample->fan_duty,
+            .fan_rpms = (uint16_t) sample->fan_rpms
+    };
+    ec_trace_append(trace_writer, &record);
 }
 
 static int calculate_fan_duty(int raw_duty) {
@@ -604,41 +1228,6 @@ static int calculate_fan_rpms(int raw_rpm_high, int raw_rpm_low) {
     return raw_rpm > 0 ? (2156220 / raw_rpm) : 0;
 }
 
-static int check_proc_instances(const char* proc_name) {
-    int proc_name_len = strlen(proc_name);
-    pid_t this_pid = getpid();
-    DIR* dir;
-    if (!(dir = opendir("/proc"))) {
-        perror("can't open /proc");
-        return -1;
-    }
-    int instance_count = 0;
-    struct dirent* ent;
-    while ((ent = readdir(dir)) != NULL) {
-        char* endptr;
-        long lpid = strtol(ent->d_name, &endptr, 10);
-        if (*endptr != '\0')
-            continue;
-        if (lpid == this_pid)
-            continue;
-        char buf[512];
-        snprintf(buf, sizeof(buf), "/proc/%ld/comm", lpid);
-        FILE* fp = fopen(buf, "r");
-        if (fp) {
-            if (fgets(buf, sizeof(buf), fp) != NULL) {
-                if ((buf[proc_name_len] == '\n' || buf[proc_name_len] == '\0')
-                        && strncmp(buf, proc_name, proc_name_len) == 0) {
-                    fprintf(stderr, "Process: %ld\n", lpid);
-                    instance_count += 1;
-                }
-            }
-            fclose(fp);
-        }
-    }
-    closedir(dir);
-    return instance_count;
-}
-
 static void get_time_string(char* buffer, size_t max, const char* format) {
     time_t timer;
     struct tm tm_info;
@@ -658,10 +1247,179 @@ static void signal_term(__sighandler_t handler) {
     signal(SIGUSR2, handler);
 }
 
+// The signals signal_term() handles
+static void signal_term_set(sigset_t* signals) {
+    sigemptyset(signals);
+    sigaddset(signals, SIGHUP);
+    sigaddset(signals, SIGINT);
+    sigaddset(signals, SIGQUIT);
+    sigaddset(signals, SIGPIPE);
+    sigaddset(signals, SIGALRM);
+    sigaddset(signals, SIGTERM);
+    sigaddset(signals, SIGUSR1);
+    sigaddset(signals, SIGUSR2);
+}
+
 static void parse_command_line(int argc, char* argv[]) {
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--debug") == 0) {
             debug_mode = 1;
+        } else if (strcmp(argv[i], "--backend") == 0) {
+            if (i + 1 < argc) {
+                int type = ec_backend_parse(argv[i + 1]);
+                if (type < 0) {
+                    printf("Error: unknown backend '%s'\n", argv[i + 1]);
+                    exit(EXIT_FAILURE);
+                }
+                backend_type = type;
+                i++; // Skip the next argument
+            } else {
+                printf("Error: --backend requires a value\n");
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--ec-extra-regs") == 0) {
+            if (i + 1 < argc) {
+                char* list = argv[i + 1];
+                char* endptr = list;
+                while (*endptr != '\0' && ec_extra_reg_count < EC_EXTRA_REG_MAX) {
+                    long reg = strtol(list, &endptr, 0);
+                    if (endptr == list || reg < 0 || reg >= EC_REG_SIZE
+                            || (*endptr != ',' && *endptr != '\0')) {
+                        printf("Error: invalid register list '%s'\n", argv[i + 1]);
+                        exit(EXIT_FAILURE);
+                    }
+                    ec_extra_regs[ec_extra_reg_count++] = (uint8_t) reg;
+                    list = *endptr == ',' ? endptr + 1 : endptr;
+                }
+                ec_sysfs_add_plan_registers(ec_extra_regs, ec_extra_reg_count);
+                i++; // Skip the next argument
+            } else {
+                printf("Error: --ec-extra-regs requires a value\n");
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--ec-max-age") == 0) {
+            if (i + 1 < argc) {
+                char* list = argv[i + 1];
+                char* endptr = list;
+                while (*endptr != '\0') {
+                    long reg = strtol(list, &endptr, 0);
+                    if (endptr == list || reg < 0 || reg >= EC_REG_SIZE || *endptr != '=') {
+                        printf("Error: invalid max-age list '%s'\n", argv[i + 1]);
+                        exit(EXIT_FAILURE);
+                    }
+                    list = endptr + 1;
+                    long max_age_ms = strtol(list, &endptr, 10);
+                    if (endptr == list || max_age_ms < 0
+                            || (*endptr != ',' && *endptr != '\0')) {
+                        printf("Error: invalid max-age list '%s'\n", argv[i + 1]);
+                        exit(EXIT_FAILURE);
+                    }
+                    ec_cache_set_max_age((uint8_t) reg, (unsigned int) max_age_ms);
+                    list = *endptr == ',' ? endptr + 1 : endptr;
+                }
+                i++; // Skip the next argument
+            } else {
+                printf("Error: --ec-max-age requires a value\n");
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--ec-snapshot-us") == 0) {
+            if (i + 1 < argc) {
+                int budget_us = atoi(argv[i + 1]);
+                if (budget_us < 0) budget_us = 0;
+                if (budget_us > 100000) budget_us = 100000;
+                ec_snapshot_set_budget_us(budget_us);
+                i++; // Skip the next argument
+            } else {
+                printf("Error: --ec-snapshot-us requires a value\n");
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--sim-speed") == 0) {
+            if (i + 1 < argc) {
+                double speed = atof(argv[i + 1]);
+                if (speed < 1.0) speed = 1.0;
+                if (speed > 3600.0) speed = 3600.0;
+                ec_sim_config()->time_scale = speed;
+                i++; // Skip the next argument
+            } else {
+                printf("Error: --sim-speed requires a value\n");
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--record") == 0) {
+            if (i + 1 < argc) {
+                record_path = argv[i + 1];
+                i++; // Skip the next argument
+            } else {
+                printf("Error: --record requires a file\n");
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--replay") == 0) {
+            if (i + 1 < argc) {
+                replay_path = argv[i + 1];
+                i++; // Skip the next argument
+            } else {
+                printf("Error: --replay requires a file\n");
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--telemetry") == 0) {
+            telemetry_mode = 1;
+        } else if (strcmp(argv[i], "--daemon") == 0) {
+            daemon_mode = 1;
+        } else if (strcmp(argv[i], "--rt") == 0) {
+            if (i + 1 < argc && ec_rt_parse(argv[i + 1]) >= 0) {
+                ec_rt_config()->policy = ec_rt_parse(argv[i + 1]);
+                i++; // Skip the next argument
+            } else {
+                printf("Error: --rt requires fifo or deadline\n");
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--rt-priority") == 0) {
+            if (i + 1 < argc) {
+                int priority = atoi(argv[i + 1]);
+                if (priority < 1) priority = 1;
+                if (priority > 99) priority = 99;
+                ec_rt_config()->priority = priority;
+                i++; // Skip the next argument
+            } else {
+                printf("Error: --rt-priority requires a value\n");
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--pid") == 0) {
+            if (i + 1 < argc && fan_pid_parse_gains(argv[i + 1]) == EXIT_SUCCESS) {
+                i++; // Skip the next argument
+            } else {
+                printf("Error: --pid requires kp,ki,kd (each 0-100)\n");
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--slo-ms") == 0) {
+            if (i + 1 < argc) {
+                slo_ms = atoi(argv[i + 1]);
+                if (slo_ms < 1) slo_ms = 1;
+                if (slo_ms > 10000) slo_ms = 10000;
+                i++; // Skip the next argument
+            } else {
+                printf("Error: --slo-ms requires a value\n");
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--power-save") == 0) {
+            ec_power_config()->enabled = 1;
+        } else if (strcmp(argv[i], "--rt-cpu") == 0) {
+            if (i + 1 < argc) {
+                int cpu = atoi(argv[i + 1]);
+                if (cpu < 0) cpu = 0;
+                ec_rt_config()->cpu = cpu;
+                i++; // Skip the next argument
+            } else {
+                printf("Error: --rt-cpu requires a value\n");
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--benchmark") == 0) {
+            benchmark_iterations = 1000;
+            if (i + 1 < argc && argv[i + 1][0] != '-' && atoi(argv[i + 1]) > 0) {
+                benchmark_iterations = atoi(argv[i + 1]);
+                i++; // Skip the next argument
+            }
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            stats_mode = 1;
         } else if (strcmp(argv[i], "--status") == 0) {
             status_mode = 1;
         } else if (strcmp(argv[i], "--interval") == 0) {
@@ -684,6 +1442,28 @@ static void parse_command_line(int argc, char* argv[]) {
                 printf("Error: --target-temp requires a value\n");
                 exit(EXIT_FAILURE);
             }
+        } else if (strcmp(argv[i], "--ec-spin-us") == 0) {
+            if (i + 1 < argc) {
+                int spin_us = atoi(argv[i + 1]);
+                if (spin_us < 0) spin_us = 0;
+                if (spin_us > 10000) spin_us = 10000;
+                ec_port_wait_config()->spin_us = spin_us;
+                i++; // Skip the next argument
+            } else {
+                printf("Error: --ec-spin-us requires a value\n");
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--ec-max-sleep-us") == 0) {
+            if (i + 1 < argc) {
+                int sleep_us = atoi(argv[i + 1]);
+                if (sleep_us < (int) ec_port_wait_config()->sleep_min_us) sleep_us = ec_port_wait_config()->sleep_min_us;
+                if (sleep_us > 100000) sleep_us = 100000;
+                ec_port_wait_config()->sleep_max_us = sleep_us;
+                i++; // Skip the next argument
+            } else {
+                printf("Error: --ec-max-sleep-us requires a value\n");
+                exit(EXIT_FAILURE);
+            }
         } else if (strcmp(argv[i], "-?") == 0 || strcmp(argv[i], "--help") == 0) {
             printf(
                     "\n\
@@ -694,8 +1474,27 @@ Dump/Control fan duty on Clevo laptops. Display indicator by default.\n\
 Options:\n\
   --debug\t\tEnable debug output\n\
   --status\t\tEnable live status display mode\n\
+  --stats\t\tReport EC transaction statistics (latency, timeouts, retries)\n\
+  --backend <name>\tEC access method: auto, port, sysfs, devport, mock or sim (default: auto)\n\
+  --ec-extra-regs <list>\tAlso read these EC registers each sample, e.g. 0x10,0x11 (max 16)\n\
+  --ec-max-age <list>\tPer-register cache budget in ms, e.g. 0xCD=2000,0xD0=500\n\
+  --ec-snapshot-us <n>\tSweep all 256 EC registers using at most n us of bus time per tick (default: off)\n\
+  --sim-speed <x>\tRun the sim backend's thermal model x times faster than real time (default: 1)\n\
+  --record <file>\tRecord every sample and fan duty write to a binary trace\n\
+  --replay <file>\tRun a recorded trace through the fan controller and exit\n\
+  --telemetry\t\tPrint the running instance's telemetry without touching the EC\n\
+  --daemon\t\tOwn the EC and serve other invocations over /run/clevo-indicator.sock\n\
+  --rt <policy>\t\tRun the EC worker under fifo or deadline scheduling with locked memory\n\
+  --rt-priority <n>\tSCHED_FIFO priority for --rt fifo (1-99, default: 10)\n\
+  --rt-cpu <n>\t\tPin the EC worker to CPU n (--rt fifo only)\n\
+  --slo-ms <n>\t\tCount worker iterations done later than n ms after their tick (default: 50)\n\
+  --power-save\t\tTimer slack, wakeups on a shared 100 ms grid, slower periods on battery\n\
+  --benchmark [n]\tTime n reads on every available backend and exit (default: 1000)\n\
   --interval <sec>\tSet status update interval (1-60 seconds, default: 2)\n\
   --target-temp <\u00b0C>\tSet the target temperature for auto fan control (40-100\u00b0C, default: 65)\n\
+  --pid <kp,ki,kd>\tAuto fan control gains in duty %% per \u00b0C, \u00b0C*s and \u00b0C/s (default: 8,1,6)\n\
+  --ec-spin-us <us>\tBusy-poll the EC status port this long before sleeping (0-10000, default: 50)\n\
+  --ec-max-sleep-us <us>\tCap for the exponential EC wait backoff (default: 1000)\n\
   -?, --help\t\tDisplay this help and exit\n\
 \n\
 Arguments:\n\
@@ -709,6 +1508,7 @@ Status Display Mode:\n\
 Target Temperature Control:\n\
   Use --target-temp to set the desired temperature for auto fan control.\n\
   The system will attempt to keep temperatures at or below this value.\n\
+  A PID controller drives the fan towards it; --pid tunes its gains.\n\
   Example: --target-temp 60 will try to keep temps below 60\u00b0C.\n\
 \n\
 Modern Privilege Management:\n\
@@ -725,6 +1525,12 @@ This program now supports multiple privilege elevation methods:\n\
    sudo chown root bin/clevo-indicator\n\
    sudo chmod u+s bin/clevo-indicator\n\
 \n\
+4. Daemon (one privileged sampler, unprivileged clients):\n\
+   make install-daemon\n\
+   While the daemon runs, the indicator, --status, dump and fan duty\n\
+   invocations talk to it instead of opening the EC themselves. Members\n\
+   of the adm group may change the fan duty; anyone may read.\n\
+\n\
 Note any fan duty change should take 1-2 seconds to come into effect - you\n\
 can verify by the fan speed displayed on indicator icon and also louder fan\n\
 noise.\n\
@@ -738,6 +1544,8 @@ process.\n\
 DO NOT MANIPULATE OR QUERY EC I/O PORTS WHILE THIS PROGRAM IS RUNNING.\n\
 \n");
             exit(EXIT_SUCCESS);
+        } else if (argv[i][0] != '-' && fan_duty_arg == -1) {
+            fan_duty_arg = i;
         }
     }
 }
@@ -868,87 +1676,35 @@ static void status_display_show_help(void) {
     printf("Press Ctrl+C to exit\n\n");
 }
 
-static void status_display_update(void) {
-    // Get current values
-    int cpu_temp = ec_query_cpu_temp();
-    int gpu_temp = ec_query_gpu_temp();
-    int fan_duty = ec_query_fan_duty();
-    int fan_rpms = ec_query_fan_rpms();
-    
-    // Get current time
-    char time_str[64];
-    get_time_string(time_str, sizeof(time_str), "%H:%M:%S");
-    
-    // Clear screen and move to top
-    status_clear_screen();
-    
-    // Header
-    printf("\033[1;36m=== Clevo Fan Control - Live Status ===\033[0m\n");
-    printf("Time: %s | Update Interval: %ds\n\n", time_str, status_interval);
-    
-    // Temperature section
-    printf("\033[1mTemperatures:\033[0m\n");
-    char* cpu_color = status_get_color_code(cpu_temp);
-    char* gpu_color = status_get_color_code(gpu_temp);
-    
-    printf("CPU: %s[%s] %s%d°C\033[0m\n", 
-           cpu_color, status_get_temp_bar(cpu_temp, 100), cpu_color, cpu_temp);
-    printf("GPU: %s[%s] %s%d°C\033[0m\n", 
-           gpu_color, status_get_temp_bar(gpu_temp, 100), gpu_color, gpu_temp);
-    
-    // Fan section
-    printf("\n\033[1mFan Status:\033[0m\n");
-    printf("Duty: %d%%\n", fan_duty);
-    printf("RPM:  [%s] %d RPM\n", status_get_fan_bar(fan_rpms, 4400), fan_rpms);
-    
-    // Mode indicator
-    printf("\n\033[1mControl Mode:\033[0m ");
-    if (fan_duty == 0) {
-        printf("\033[32m[AUTO]\033[0m - Automatic temperature-based control\n");
-    } else {
-        printf("\033[33m[MANUAL: %d%%]\033[0m - Manual fan control\n", fan_duty);
-    }
-    
-    // Status indicators
-    printf("\n\033[1mStatus:\033[0m\n");
-    if (cpu_temp > 80 || gpu_temp > 80) {
-        printf("  \033[31m⚠ CRITICAL TEMPERATURE\033[0m\n");
-    } else if (cpu_temp > 70 || gpu_temp > 70) {
-        printf("  \033[33m⚠ HIGH TEMPERATURE\033[0m\n");
-    } else {
-        printf("  \033[32m✓ Normal operation\033[0m\n");
-    }
-    
-    // Footer
-    printf("\n\033[2mPress Ctrl+C to exit\033[0m\n");
-    fflush(stdout);
-}
-
 static void status_display_update_with_control(void) {
     // Update shared memory with current values
-    share_info->cpu_temp = ec_query_cpu_temp();
-    share_info->gpu_temp = ec_query_gpu_temp();
-    share_info->fan_duty = ec_query_fan_duty();
-    share_info->fan_rpms = ec_query_fan_rpms();
+    uint64_t woke_ns = ec_stats_now_ns();
+    ec_sample_t sample;
+    if (ec_query_sample(&sample) == EXIT_SUCCESS) {
+        publish_sample(&sample, woke_ns);
+        trace_record_sample(&sample);
+    }
     
     // Run auto fan control logic
-    if (share_info->auto_duty == 1) {
-        int next_duty = ec_auto_duty_adjust();
-        if (next_duty != 0 && next_duty != share_info->auto_duty_val) {
+    if (auto_duty == 1) {
+        int next_duty = ec_auto_duty_adjust(ec_sample_clock_ns());
+        if (next_duty != 0 && next_duty != auto_duty_val) {
             char s_time[256];
             get_time_string(s_time, 256, "%m/%d %H:%M:%S");
-            printf("%s CPU=%d°C, GPU=%d°C, auto fan duty to %d%%\n", s_time, share_info->cpu_temp, share_info->gpu_temp, next_duty);
-            printf("[DEBUG] Attempting to set fan duty to %d\n", next_duty);
+            printf("%s CPU=%d°C, GPU=%d°C, auto fan duty to %d%%\n", s_time, latest.cpu_temp, latest.gpu_temp, next_duty);
+            // Read-back happens with the next sample, not as an extra transaction
             int write_result = ec_write_fan_duty(next_duty);
-            printf("[DEBUG] ec_write_fan_duty returned: %d\n", write_result);
-            int verify_duty = ec_query_fan_duty();
-            printf("[DEBUG] Fan duty after write: %d\n", verify_duty);
             if (debug_mode) printf("[DEBUG] ec_write_fan_duty (auto) returned: %d\n", write_result);
-            share_info->auto_duty_val = next_duty;
-            share_info->fan_duty = next_duty; // Update the displayed value
+            auto_duty_val = next_duty;
+            latest.fan_duty = next_duty; // Update the displayed value
         }
     }
-    
+    status_display_render(&telemetry_shm->history);
+}
+
+// Draw the latest sample; without a local EC backend (a daemon client) the
+// bus statistics are not ours to show
+static void status_display_render(const ec_history_t* history) {
     // Get current time
     char time_str[64];
     get_time_string(time_str, sizeof(time_str), "%H:%M:%S");
@@ -962,37 +1718,63 @@ static void status_display_update_with_control(void) {
     
     // Temperature section
     printf("\033[1mTemperatures:\033[0m\n");
-    char* cpu_color = status_get_color_code(share_info->cpu_temp);
-    char* gpu_color = status_get_color_code(share_info->gpu_temp);
+    char* cpu_color = status_get_color_code(latest.cpu_temp);
+    char* gpu_color = status_get_color_code(latest.gpu_temp);
     
     printf("CPU: %s[%s] %s%d°C\033[0m\n", 
-           cpu_color, status_get_temp_bar(share_info->cpu_temp, 100), cpu_color, share_info->cpu_temp);
+           cpu_color, status_get_temp_bar(latest.cpu_temp, 100), cpu_color, latest.cpu_temp);
     printf("GPU: %s[%s] %s%d°C\033[0m\n", 
-           gpu_color, status_get_temp_bar(share_info->gpu_temp, 100), gpu_color, share_info->gpu_temp);
+           gpu_color, status_get_temp_bar(latest.gpu_temp, 100), gpu_color, latest.gpu_temp);
+    // The ring may hold less than a minute at short sample periods
+    double trend;
+    uint64_t span_ns;
+    if (history != NULL && ec_history_temp_rate(history, 60ULL * 1000000000ULL, &trend, &span_ns) == EXIT_SUCCESS)
+        printf("Trend: %+.1f°C/min over the last %.0f s\n", trend, (double) span_ns / 1e9);
     
     // Fan section
     printf("\n\033[1mFan Status:\033[0m\n");
-    printf("Duty: %d%%\n", share_info->fan_duty);
-    printf("RPM:  [%s] %d RPM\n", status_get_fan_bar(share_info->fan_rpms, 4400), share_info->fan_rpms);
+    printf("Duty: %d%%\n", latest.fan_duty);
+    printf("RPM:  [%s] %d RPM\n", status_get_fan_bar(latest.fan_rpms, 4400), latest.fan_rpms);
+    if (ec_backend != NULL) {
+        const ec_op_stats_t* batch = &ec_stats_get()->ops[EC_OP_BATCH];
+        printf("EC bus (%s): %llu us last read (max %llu us)\n",
+               ec_backend_name(ec_backend->type),
+               (unsigned long long) (batch->last_ns / 1000),
+               (unsigned long long) (batch->latency.max_ns / 1000));
+        const ec_wait_stats_t* wait_stats = &ec_stats_get()->wait;
+        printf("EC wait: %llu spin / %llu sleep / %llu timeout, worst-phase p99 %.1f us\n",
+               (unsigned long long) wait_stats->spin_hits,
+               (unsigned long long) wait_stats->sleep_hits,
+               (unsigned long long) wait_stats->timeouts,
+               MAX(ec_histogram_percentile(&wait_stats->spin_latency, 99.0),
+                   ec_histogram_percentile(&wait_stats->sleep_latency, 99.0)) / 1000.0);
+    }
     
     // Mode indicator
     printf("\n\033[1mControl Mode:\033[0m ");
-    if (share_info->auto_duty == 1) {
+    if (ec_backend == NULL) {
+        printf("\033[36m[DAEMON]\033[0m - Controlled by clevo-indicator --daemon\n");
+    } else if (auto_duty == 1) {
         printf("\033[32m[AUTO]\033[0m - Automatic temperature-based control\n");
     } else {
-        printf("\033[33m[MANUAL: %d%%]\033[0m - Manual fan control\n", share_info->fan_duty);
+        printf("\033[33m[MANUAL: %d%%]\033[0m - Manual fan control\n", latest.fan_duty);
     }
     
     // Status indicators
     printf("\n\033[1mStatus:\033[0m\n");
-    if (share_info->cpu_temp > 80 || share_info->gpu_temp > 80) {
+    if (latest.cpu_temp > 80 || latest.gpu_temp > 80) {
         printf("  \033[31m⚠ CRITICAL TEMPERATURE\033[0m\n");
-    } else if (share_info->cpu_temp > 70 || share_info->gpu_temp > 70) {
+    } else if (latest.cpu_temp > 70 || latest.gpu_temp > 70) {
         printf("  \033[33m⚠ HIGH TEMPERATURE\033[0m\n");
     } else {
         printf("  \033[32m✓ Normal operation\033[0m\n");
     }
     
+    if (stats_mode && ec_backend != NULL) {
+        printf("\n\033[1mEC Statistics:\033[0m\n");
+        ec_stats_print(stdout, ec_stats_get());
+    }
+
     // Footer
     printf("\n\033[2mPress Ctrl+C to exit\033[0m\n");
     fflush(stdout);
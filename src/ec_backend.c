@@ -0,0 +1,173 @@
+#include "ec_backend.h"
+#include "ec_stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char* backend_names[EC_BACKEND_COUNT] = {
+        [EC_BACKEND_AUTO] = "auto",
+        [EC_BACKEND_PORT] = "port",
+        [EC_BACKEND_SYSFS] = "sysfs",
+        [EC_BACKEND_DEVPORT] = "devport",
+        [EC_BACKEND_MOCK] = "mock",
+        [EC_BACKEND_SIM] = "sim"
+};
+
+ec_backend_t* ec_backend_open(ec_backend_type_t type) {
+    ec_backend_t* backend = NULL;
+    switch (type) {
+        case EC_BACKEND_AUTO: {
+            // Skip the probe when the last choice still works
+            ec_backend_type_t cached = ec_backend_cached();
+            if (cached != EC_BACKEND_AUTO && (backend = ec_backend_open(cached)) != NULL)
+                return backend;
+            // Cheapest and safest first: the kernel serializes debugfs reads
+            if ((backend = ec_sysfs_open()) == NULL
+                    && (backend = ec_port_open()) == NULL
+                    && (backend = ec_devport_open()) == NULL)
+                return NULL;
+            ec_backend_remember(backend->type);
+            return backend;
+        }
+        case EC_BACKEND_PORT:
+            return ec_port_open();
+        case EC_BACKEND_SYSFS:
+            return ec_sysfs_open();
+        case EC_BACKEND_DEVPORT:
+            return ec_devport_open();
+        case EC_BACKEND_MOCK:
+            return ec_mock_open();
+        case EC_BACKEND_SIM:
+            return ec_sim_open();
+        default:
+            errno = EINVAL;
+            return NULL;
+    }
+}
+
+ec_backend_type_t ec_backend_cached(void) {
+    char name[16] = {0};
+    int fd = open(EC_BACKEND_CACHE_PATH, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return EC_BACKEND_AUTO;
+    ssize_t n = read(fd, name, sizeof(name) - 1);
+    close(fd);
+    if (n <= 0)
+        return EC_BACKEND_AUTO;
+    name[strcspn(name, "\n")] = '\0';
+    int type = ec_backend_parse(name);
+    // Only hardware backends are worth caching
+    if (type != EC_BACKEND_SYSFS && type != EC_BACKEND_PORT && type != EC_BACKEND_DEVPORT)
+        return EC_BACKEND_AUTO;
+    return type;
+}
+
+void ec_backend_remember(ec_backend_type_t type) {
+    if (type != EC_BACKEND_SYSFS && type != EC_BACKEND_PORT && type != EC_BACKEND_DEVPORT)
+        return;
+    if (ec_backend_cached() == type)
+        return;
+    // Best effort: only root can write to /run
+    int fd = open(EC_BACKEND_CACHE_PATH, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return;
+    char line[16];
+    int len = snprintf(line, sizeof(line), "%s\n", ec_backend_name(type));
+    if (write(fd, line, len) != len)
+        unlink(EC_BACKEND_CACHE_PATH);
+    close(fd);
+}
+
+int ec_backend_parse(const char* name) {
+    for (int i = 0; i < EC_BACKEND_COUNT; i++) {
+        if (strcmp(name, backend_names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+const char* ec_backend_name(ec_backend_type_t type) {
+    if (type < 0 || type >= EC_BACKEND_COUNT)
+        return "unknown";
+    return backend_names[type];
+}
+
+int ec_backend_read_batch(ec_backend_t* backend, const uint8_t* regs,
+        uint8_t* out, size_t n) {
+    if (backend->ops->layered)
+        return backend->ops->read_batch(backend, regs, out, n);
+    uint64_t start = ec_stats_now_ns();
+    int result = backend->ops->read_batch(backend, regs, out, n);
+    ec_stats_record(EC_OP_BATCH, ec_stats_now_ns() - start, n,
+            result != EXIT_SUCCESS);
+    return result;
+}
+
+int ec_backend_write(ec_backend_t* backend, uint8_t cmd, uint8_t port,
+        uint8_t value) {
+    return backend->ops->write(backend, cmd, port, value);
+}
+
+int ec_backend_snapshot(ec_backend_t* backend, uint8_t* regs) {
+    return backend->ops->snapshot(backend, regs);
+}
+
+int ec_backend_read_range(ec_backend_t* backend, uint8_t first, uint8_t* out,
+        size_t n) {
+    if (backend->ops->read_range != NULL)
+        return backend->ops->read_range(backend, first, out, n);
+    uint8_t regs[EC_REG_SIZE];
+    for (size_t i = 0; i < n; i++)
+        regs[i] = (uint8_t) (first + i);
+    return backend->ops->read_batch(backend, regs, out, n);
+}
+
+ec_health_t ec_backend_health(ec_backend_t* backend) {
+    return backend->ops->health(backend);
+}
+
+void ec_backend_close(ec_backend_t* backend) {
+    if (backend != NULL)
+        backend->ops->close(backend);
+}
+
+void ec_backend_benchmark(FILE* out, int iterations) {
+    static const uint8_t regs[] = {
+            EC_REG_CPU_TEMP, EC_REG_GPU_TEMP, EC_REG_FAN_DUTY,
+            EC_REG_FAN_RPMS_HI, EC_REG_FAN_RPMS_LO
+    };
+    fprintf(out, "Benchmarking EC backends (%d iterations)\n", iterations);
+    for (int type = EC_BACKEND_PORT; type < EC_BACKEND_COUNT; type++) {
+        ec_backend_t* backend = ec_backend_open(type);
+        if (backend == NULL) {
+            fprintf(out, "  %-8s unavailable: %s\n", ec_backend_name(type), strerror(errno));
+            continue;
+        }
+        ec_histogram_t batch;
+        ec_histogram_t snapshot;
+        ec_histogram_reset(&batch);
+        ec_histogram_reset(&snapshot);
+        uint8_t values[EC_REG_SIZE];
+        int failures = 0;
+        for (int i = 0; i < iterations; i++) {
+            uint64_t start = ec_stats_now_ns();
+            failures += ec_backend_read_batch(backend, regs, values,
+                    sizeof(regs)) != EXIT_SUCCESS;
+            ec_histogram_record(&batch, ec_stats_now_ns() - start);
+        }
+        // A full snapshot over port I/O is 256 handshakes, keep it short
+        int snapshot_iterations = iterations < 10 ? iterations : 10;
+        for (int i = 0; i < snapshot_iterations; i++) {
+            uint64_t start = ec_stats_now_ns();
+            failures += ec_backend_snapshot(backend, values) != EXIT_SUCCESS;
+            ec_histogram_record(&snapshot, ec_stats_now_ns() - start);
+        }
+        fprintf(out, "%s (%d failures):\n", ec_backend_name(type), failures);
+        ec_histogram_print(out, "sample batch", &batch);
+        ec_histogram_print(out, "full snapshot", &snapshot);
+        ec_backend_close(backend);
+    }
+}
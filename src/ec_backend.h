@@ -0,0 +1,154 @@
+#ifndef EC_BACKEND_H
+#define EC_BACKEND_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* EC registers can be read by EC_SC_READ_CMD or /sys/kernel/debug/ec/ec0/io:
+ *
+ * 1. modprobe ec_sys
+ * 2. od -Ax -t x1 /sys/kernel/debug/ec/ec0/io
+ */
+
+#define EC_REG_SIZE 0x100
+#define EC_REG_CPU_TEMP 0x07
+#define EC_REG_GPU_TEMP 0xCD
+#define EC_REG_FAN_DUTY 0xCE
+#define EC_REG_FAN_RPMS_HI 0xD0
+#define EC_REG_FAN_RPMS_LO 0xD1
+
+#define EC_CMD_FAN_DUTY 0x99
+#define EC_FAN_DUTY_PORT 0x01
+
+#ifndef EC_SYSFS_PATH
+#define EC_SYSFS_PATH "/sys/kernel/debug/ec/ec0/io"
+#endif
+#ifndef EC_DEVPORT_PATH
+#define EC_DEVPORT_PATH "/dev/port"
+#endif
+#ifndef EC_SYS_MODULE_PATH
+#define EC_SYS_MODULE_PATH "/sys/module/ec_sys"
+#endif
+// Last backend EC_BACKEND_AUTO settled on; tmpfs, so it is forgotten on reboot
+#ifndef EC_BACKEND_CACHE_PATH
+#define EC_BACKEND_CACHE_PATH "/run/clevo-indicator.backend"
+#endif
+
+typedef enum {
+    EC_BACKEND_AUTO = 0,
+    EC_BACKEND_PORT,
+    EC_BACKEND_SYSFS,
+    EC_BACKEND_DEVPORT,
+    EC_BACKEND_MOCK,
+    EC_BACKEND_SIM,
+    EC_BACKEND_COUNT
+} ec_backend_type_t;
+
+typedef enum {
+    EC_HEALTH_OK = 0,
+    EC_HEALTH_DEGRADED,   // last operation had timeouts or short reads
+    EC_HEALTH_FAILED      // backend unusable, caller should switch
+} ec_health_t;
+
+typedef struct ec_backend ec_backend_t;
+
+typedef struct {
+    // Read n registers into out, EXIT_SUCCESS or EXIT_FAILURE
+    int (*read_batch)(ec_backend_t* backend, const uint8_t* regs,
+            uint8_t* out, size_t n);
+    // Issue an EC command with a port/value pair (e.g. 0x99 fan duty)
+    int (*write)(ec_backend_t* backend, uint8_t cmd, uint8_t port,
+            uint8_t value);
+    // Fill all EC_REG_SIZE registers
+    int (*snapshot)(ec_backend_t* backend, uint8_t* regs);
+    // Read n consecutive registers from first, leaving any read plan alone.
+    // Optional: without it ec_backend_read_range() goes through read_batch.
+    int (*read_range)(ec_backend_t* backend, uint8_t first, uint8_t* out,
+            size_t n);
+    // Set by layers over another backend (the cache): only the inner
+    // backend's batches are bus time, so these are not timed themselves
+    int layered;
+    ec_health_t (*health)(ec_backend_t* backend);
+    void (*close)(ec_backend_t* backend);
+} ec_backend_ops_t;
+
+// Every implementation embeds this as its first member
+struct ec_backend {
+    const ec_backend_ops_t* ops;
+    ec_backend_type_t type;
+};
+
+// Open a backend; EC_BACKEND_AUTO tries the cached backend, then probes
+// sysfs, port I/O and /dev/port, and caches the one that opened.
+// Returns NULL (with errno set) when the requested backend is unavailable.
+ec_backend_t* ec_backend_open(ec_backend_type_t type);
+
+// Backend EC_BACKEND_AUTO used last, EC_BACKEND_AUTO if none is cached
+ec_backend_type_t ec_backend_cached(void);
+
+// Remember a hardware backend for the next EC_BACKEND_AUTO open
+void ec_backend_remember(ec_backend_type_t type);
+
+// Parse a backend name from the command line, -1 if unknown
+int ec_backend_parse(const char* name);
+
+// Human-readable backend name
+const char* ec_backend_name(ec_backend_type_t type);
+
+// Dispatch helpers; read_batch also feeds the EC_OP_BATCH statistics for
+// backends that are not layered
+int ec_backend_read_batch(ec_backend_t* backend, const uint8_t* regs,
+        uint8_t* out, size_t n);
+int ec_backend_write(ec_backend_t* backend, uint8_t cmd, uint8_t port,
+        uint8_t value);
+int ec_backend_snapshot(ec_backend_t* backend, uint8_t* regs);
+int ec_backend_read_range(ec_backend_t* backend, uint8_t first, uint8_t* out,
+        size_t n);
+ec_health_t ec_backend_health(ec_backend_t* backend);
+void ec_backend_close(ec_backend_t* backend);
+
+// Time every available backend and print a comparison
+void ec_backend_benchmark(FILE* out, int iterations);
+
+// Tuning for the port-I/O status wait: spin on inb for spin_us, then sleep
+// with exponential backoff from sleep_min_us up to sleep_max_us until
+// timeout_us. A timed-out handshake step is retried up to step_retries
+// times after a jittered backoff starting at retry_backoff_us; a
+// transaction that still fails puts the bus into a cooldown_ms cooldown
+// during which transactions fail immediately.
+typedef struct {
+    unsigned int spin_us;
+    unsigned int sleep_min_us;
+    unsigned int sleep_max_us;
+    unsigned int timeout_us;
+    unsigned int step_retries;
+    unsigned int retry_backoff_us;
+    unsigned int cooldown_ms;
+    unsigned int spin_iterations; // derived from spin_us when a port backend opens
+    uint64_t inb_ns;              // measured cost of one status poll
+} ec_wait_config_t;
+
+// Shared by the port I/O and /dev/port backends
+ec_wait_config_t* ec_port_wait_config(void);
+
+// Implementations (ec_port.c, ec_sysfs.c, ec_mock.c, ec_sim.c)
+ec_backend_t* ec_port_open(void);
+ec_backend_t* ec_devport_open(void);
+ec_backend_t* ec_sysfs_open(void);
+ec_backend_t* ec_mock_open(void);
+ec_backend_t* ec_sim_open(void);
+
+// Registers the sysfs backend reads every sample besides the ones the
+// controller needs; applies to backends opened afterwards
+void ec_sysfs_add_plan_registers(const uint8_t* regs, size_t n);
+
+// Make sure ec_sys is loaded: a stat when it already is, otherwise
+// finit_module on the module file, then a spawned modprobe (never a shell).
+// EXIT_SUCCESS once EC_SYS_MODULE_PATH exists.
+int ec_sysfs_load_module(void);
+
+// Poke a register of the in-memory mock
+void ec_mock_set_register(ec_backend_t* backend, uint8_t reg, uint8_t value);
+
+#endif // EC_BACKEND_H
@@ -0,0 +1,206 @@
+#include "ec_cache.h"
+#include "ec_stats.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    ec_backend_t base;
+    ec_backend_t* inner;
+    uint64_t max_age_ns[EC_REG_SIZE];
+    uint64_t read_at_ns[EC_REG_SIZE];   // 0 if never read or invalidated
+    uint8_t values[EC_REG_SIZE];
+    int confirmed_duty;   // raw duty we wrote and read back, -1 if none
+    int pending_duty;     // raw duty written but not yet read back, -1 if none
+} ec_cache_backend_t;
+
+static int max_age_configured = 0;
+static unsigned int configured_max_age_ms[EC_REG_SIZE];
+
+static void cache_default_max_ages(void) {
+    if (max_age_configured) return;
+    for (int reg = 0; reg < EC_REG_SIZE; reg++)
+        configured_max_age_ms[reg] = EC_CACHE_DEFAULT_MAX_AGE_MS;
+    configured_max_age_ms[EC_REG_CPU_TEMP] = EC_CACHE_CPU_TEMP_MAX_AGE_MS;
+    configured_max_age_ms[EC_REG_GPU_TEMP] = EC_CACHE_GPU_TEMP_MAX_AGE_MS;
+    configured_max_age_ms[EC_REG_FAN_DUTY] = EC_CACHE_FAN_DUTY_MAX_AGE_MS;
+    configured_max_age_ms[EC_REG_FAN_RPMS_HI] = EC_CACHE_FAN_RPMS_MAX_AGE_MS;
+    configured_max_age_ms[EC_REG_FAN_RPMS_LO] = EC_CACHE_FAN_RPMS_MAX_AGE_MS;
+    max_age_configured = 1;
+}
+
+static int cache_is_fresh(ec_cache_backend_t* cb, uint8_t reg, uint64_t now) {
+    return cb->read_at_ns[reg] != 0 && cb->max_age_ns[reg] > 0
+            && now - cb->read_at_ns[reg] <= cb->max_age_ns[reg];
+}
+
+// Verify a fan duty write against the next real read of the duty register
+// instead of issuing an extra transaction right after the write. Reads
+// only ever confirm our own writes: a duty the EC picked by itself (e.g.
+// in its auto mode before we wrote anything) must not suppress the write
+// that takes manual control.
+static void cache_observe_duty(ec_cache_backend_t* cb, uint8_t raw_duty) {
+    ec_stats_t* stats = ec_stats_get();
+    if (cb->pending_duty >= 0) {
+        if (raw_duty == cb->pending_duty) {
+            stats->duty_writes_confirmed++;
+            cb->confirmed_duty = cb->pending_duty;
+        } else {
+            stats->duty_writes_mismatched++;
+            cb->confirmed_duty = -1;
+        }
+        cb->pending_duty = -1;
+    } else if (raw_duty != cb->confirmed_duty) {
+        // The EC moved off our duty
+        cb->confirmed_duty = -1;
+    }
+}
+
+static int cache_read_batch(ec_backend_t* backend, const uint8_t* regs,
+        uint8_t* out, size_t n) {
+    ec_cache_backend_t* cb = (ec_cache_backend_t*) backend;
+    ec_stats_t* stats = ec_stats_get();
+    uint64_t now = ec_stats_now_ns();
+    uint8_t misses[EC_REG_SIZE];
+    uint8_t fetched[EC_REG_SIZE];
+    uint8_t queued[EC_REG_SIZE] = {0};
+    size_t miss_count = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        if (cache_is_fresh(cb, regs[i], now)) {
+            stats->cache_hits++;
+        } else if (!queued[regs[i]]) {
+            // A register asked for twice is still one miss
+            stats->cache_misses++;
+            queued[regs[i]] = 1;
+            misses[miss_count++] = regs[i];
+        }
+    }
+
+    int result = EXIT_SUCCESS;
+    if (miss_count > 0) {
+        // Only the registers that go to the EC count as batch bus time
+        result = ec_backend_read_batch(cb->inner, misses, fetched, miss_count);
+        if (result == EXIT_SUCCESS) {
+            uint64_t read_at = ec_stats_now_ns();
+            for (size_t i = 0; i < miss_count; i++) {
+                cb->values[misses[i]] = fetched[i];
+                cb->read_at_ns[misses[i]] = read_at;
+                if (misses[i] == EC_REG_FAN_DUTY)
+                    cache_observe_duty(cb, fetched[i]);
+            }
+        }
+    }
+    for (size_t i = 0; i < n; i++)
+        out[i] = cb->values[regs[i]];
+    return result;
+}
+
+static int cache_write(ec_backend_t* backend, uint8_t cmd, uint8_t port,
+        uint8_t value) {
+    ec_cache_backend_t* cb = (ec_cache_backend_t*) backend;
+    if (cmd != EC_CMD_FAN_DUTY || port != EC_FAN_DUTY_PORT)
+        return cb->inner->ops->write(cb->inner, cmd, port, value);
+
+    ec_stats_t* stats = ec_stats_get();
+    int expected = cb->pending_duty >= 0 ? cb->pending_duty : cb->confirmed_duty;
+    if (value == expected) {
+        stats->duty_writes_suppressed++;
+        return EXIT_SUCCESS;
+    }
+    stats->duty_writes_issued++;
+    int result = cb->inner->ops->write(cb->inner, cmd, port, value);
+    if (result == EXIT_SUCCESS) {
+        cb->pending_duty = value;
+    } else {
+        // Unknown what the EC ended up with, let the next read tell us
+        cb->pending_duty = -1;
+        cb->confirmed_duty = -1;
+    }
+    // The next scheduled read of the duty register doubles as read-back
+    cb->read_at_ns[EC_REG_FAN_DUTY] = 0;
+    return result;
+}
+
+static int cache_snapshot(ec_backend_t* backend, uint8_t* regs) {
+    ec_cache_backend_t* cb = (ec_cache_backend_t*) backend;
+    int result = cb->inner->ops->snapshot(cb->inner, regs);
+    if (result == EXIT_SUCCESS) {
+        uint64_t read_at = ec_stats_now_ns();
+        memcpy(cb->values, regs, EC_REG_SIZE);
+        for (int reg = 0; reg < EC_REG_SIZE; reg++)
+            cb->read_at_ns[reg] = read_at;
+        cache_observe_duty(cb, regs[EC_REG_FAN_DUTY]);
+    }
+    return result;
+}
+
+static int cache_read_range(ec_backend_t* backend, uint8_t first, uint8_t* out,
+        size_t n) {
+    ec_cache_backend_t* cb = (ec_cache_backend_t*) backend;
+    int result = ec_backend_read_range(cb->inner, first, out, n);
+    if (result == EXIT_SUCCESS) {
+        uint64_t read_at = ec_stats_now_ns();
+        for (size_t i = 0; i < n; i++) {
+            cb->values[first + i] = out[i];
+            cb->read_at_ns[first + i] = read_at;
+            if (first + i == EC_REG_FAN_DUTY)
+                cache_observe_duty(cb, out[i]);
+        }
+    }
+    return result;
+}
+
+static ec_health_t cache_health(ec_backend_t* backend) {
+    ec_cache_backend_t* cb = (ec_cache_backend_t*) backend;
+    return cb->inner->ops->health(cb->inner);
+}
+
+static void cache_close(ec_backend_t* backend) {
+    ec_cache_backend_t* cb = (ec_cache_backend_t*) backend;
+    ec_backend_close(cb->inner);
+    free(cb);
+}
+
+static const ec_backend_ops_t cache_ops = {
+        .read_batch = cache_read_batch,
+        .write = cache_write,
+        .snapshot = cache_snapshot,
+        .read_range = cache_read_range,
+        .layered = 1,
+        .health = cache_health,
+        .close = cache_close
+};
+
+void ec_cache_set_max_age(uint8_t reg, unsigned int max_age_ms) {
+    cache_default_max_ages();
+    configured_max_age_ms[reg] = max_age_ms;
+}
+
+void ec_cache_invalidate(ec_backend_t* backend, uint8_t reg) {
+    if (backend == NULL || backend->ops != &cache_ops) return;
+    ((ec_cache_backend_t*) backend)->read_at_ns[reg] = 0;
+}
+
+ec_backend_t* ec_cache_inner(ec_backend_t* backend) {
+    if (backend == NULL || backend->ops != &cache_ops) return backend;
+    return ((ec_cache_backend_t*) backend)->inner;
+}
+
+ec_backend_t* ec_cache_open(ec_backend_t* inner) {
+    if (inner == NULL)
+        return NULL;
+    ec_cache_backend_t* cb = calloc(1, sizeof(*cb));
+    if (cb == NULL) {
+        ec_backend_close(inner);
+        return NULL;
+    }
+    cache_default_max_ages();
+    cb->base.ops = &cache_ops;
+    cb->base.type = inner->type;
+    cb->inner = inner;
+    cb->confirmed_duty = -1;
+    cb->pending_duty = -1;
+    for (int reg = 0; reg < EC_REG_SIZE; reg++)
+        cb->max_age_ns[reg] = (uint64_t) configured_max_age_ms[reg] * 1000000ULL;
+    return &cb->base;
+}
@@ -0,0 +1,32 @@
+#ifndef EC_CACHE_H
+#define EC_CACHE_H
+
+#include "ec_backend.h"
+
+// Default staleness budgets in milliseconds; 0 means always read from the EC
+#define EC_CACHE_CPU_TEMP_MAX_AGE_MS 0
+#define EC_CACHE_GPU_TEMP_MAX_AGE_MS 1000
+#define EC_CACHE_FAN_DUTY_MAX_AGE_MS 1000
+#define EC_CACHE_FAN_RPMS_MAX_AGE_MS 400
+#define EC_CACHE_DEFAULT_MAX_AGE_MS 1000
+
+// Wrap a backend with a shadow register cache. Reads of registers younger
+// than their max-age are served from the shadow copy; the rest are fetched
+// from the inner backend in a single batch. The cache takes ownership of
+// the inner backend and reports its type and health.
+//
+// Fan duty commands are deduplicated against the last duty we wrote and
+// the EC confirmed, verified lazily by the next real read of
+// EC_REG_FAN_DUTY. A duty the EC chose by itself never suppresses a write.
+ec_backend_t* ec_cache_open(ec_backend_t* inner);
+
+// Set the staleness budget of a register for caches opened afterwards
+void ec_cache_set_max_age(uint8_t reg, unsigned int max_age_ms);
+
+// Drop the shadow copy of a register so the next read goes to the EC
+void ec_cache_invalidate(ec_backend_t* backend, uint8_t reg);
+
+// The backend a cache wraps, or `backend` itself if it is not a cache
+ec_backend_t* ec_cache_inner(ec_backend_t* backend);
+
+#endif // EC_CACHE_H
@@ -0,0 +1,37 @@
+#include "ec_command.h"
+#include "ec_stats.h"
+#include <stdlib.h>
+
+int ec_command_push(ec_command_ring_t* ring, ec_command_type_t type, int32_t value) {
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (head - tail >= EC_COMMAND_RING_SIZE) {
+        ec_stats_get()->commands.dropped++;
+        return EXIT_FAILURE;
+    }
+    ec_command_t* slot = &ring->slots[head & (EC_COMMAND_RING_SIZE - 1)];
+    slot->type = (uint32_t) type;
+    slot->value = value;
+    slot->issued_ns = ec_stats_now_ns();
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    return EXIT_SUCCESS;
+}
+
+int ec_command_pop(ec_command_ring_t* ring, ec_command_t* command) {
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (head == tail)
+        return 0;
+    *command = ring->slots[tail & (EC_COMMAND_RING_SIZE - 1)];
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+const char* ec_command_name(ec_command_type_t type) {
+    switch (type) {
+        case EC_COMMAND_SET_DUTY: return "set duty";
+        case EC_COMMAND_SET_AUTO: return "set auto";
+        case EC_COMMAND_SET_TARGET: return "set target";
+        default: return "unknown";
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef EC_COMMAND_H
+#define EC_COMMAND_H
+
+#include "ec_telemetry.h"
+#include <stdint.h>
+
+// Commands the UI hands to the EC worker
+typedef enum {
+    EC_COMMAND_SET_DUTY = 1,    // manual fan duty in percent
+    EC_COMMAND_SET_AUTO,        // back to automatic control
+    EC_COMMAND_SET_TARGET       // controller target temperature in °C
+} ec_command_type_t;
+
+typedef struct {
+    uint32_t type;              // ec_command_type_t
+    int32_t value;
+    uint64_t issued_ns;         // CLOCK_MONOTONIC when the user asked
+} ec_command_t;
+
+// Power of two so positions wrap with a mask
+#define EC_COMMAND_RING_SIZE 16
+
+// Single-producer single-consumer ring in the shared page. Each index is
+// written by one side only and lives on its own cache line; commands are
+// applied in order and none is lost unless the ring is full.
+typedef struct {
+    volatile uint32_t head __attribute__((aligned(EC_CACHELINE)));  // producer
+    volatile uint32_t tail __attribute__((aligned(EC_CACHELINE)));  // consumer
+    ec_command_t slots[EC_COMMAND_RING_SIZE] __attribute__((aligned(EC_CACHELINE)));
+} ec_command_ring_t;
+
+// Queue a command stamped with the current time; EXIT_FAILURE if full
+int ec_command_push(ec_command_ring_t* ring, ec_command_type_t type, int32_t value);
+
+// Take the oldest command; 1 if one was taken, 0 if the ring is empty
+int ec_command_pop(ec_command_ring_t* ring, ec_command_t* command);
+
+// Name of a command for reports
+const char* ec_command_name(ec_command_type_t type);
+
+#endif // EC_COMMAND_H
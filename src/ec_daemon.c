@@ -0,0 +1,275 @@
+#define _GNU_SOURCE // accept4, struct ucred
+#include "ec_daemon.h"
+#include "ec_stats.h"
+#include <errno.h>
+#include <grp.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Give up on a daemon that does not answer
+#define EC_CLIENT_TIMEOUT_MS 1000
+
+// Older libc headers lack it; the kernel has had it since 4.13
+#ifndef SO_PEERGROUPS
+#define SO_PEERGROUPS 59
+#endif
+
+static socklen_t daemon_address(struct sockaddr_un* addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    strncpy(addr->sun_path, EC_DAEMON_SOCKET_PATH, sizeof(addr->sun_path) - 1);
+    return sizeof(*addr);
+}
+
+// Root, or a member of EC_DAEMON_GROUP when it connected. Only the
+// kernel's record of the peer is consulted, never NSS, since this runs on
+// the EC worker's loop.
+static int daemon_peer_may_command(const ec_daemon_t* daemon, int fd) {
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) != 0)
+        return 0;
+    if (cred.uid == 0)
+        return 1;
+    if (!daemon->has_group)
+        return 0;
+    if (cred.gid == daemon->group_gid)
+        return 1;
+    gid_t small[64];
+    gid_t* groups = small;
+    socklen_t len = sizeof(small);
+    int result = getsockopt(fd, SOL_SOCKET, SO_PEERGROUPS, groups, &len);
+    if (result != 0 && errno == ERANGE) {
+        // len now holds the size needed
+        groups = malloc(len);
+        if (groups == NULL)
+            return 0;
+        result = getsockopt(fd, SOL_SOCKET, SO_PEERGROUPS, groups, &len);
+    }
+    int member = 0;
+    for (size_t i = 0; result == 0 && i < len / sizeof(gid_t) && !member; i++)
+        member = groups[i] == daemon->group_gid;
+    if (groups != small)
+        free(groups);
+    return member;
+}
+
+static void daemon_drop(ec_daemon_client_t* client) {
+    close(client->fd);
+    client->fd = -1;
+    client->subscribed = 0;
+    client->may_command = 0;
+}
+
+static int daemon_send(int fd, uint8_t type, int32_t status, const ec_telemetry_t* sample) {
+    ec_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.version = EC_PROTO_VERSION;
+    msg.type = type;
+    msg.status = status;
+    if (sample != NULL)
+        msg.body.sample = *sample;
+    return send(fd, &msg, sizeof(msg), MSG_DONTWAIT | MSG_NOSIGNAL) == sizeof(msg)
+            ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int ec_daemon_listen(ec_daemon_t* daemon) {
+    for (int i = 0; i < EC_DAEMON_MAX_CLIENTS; i++)
+        daemon->clients[i].fd = -1;
+    struct group* group = getgrnam(EC_DAEMON_GROUP);
+    daemon->has_group = group != NULL;
+    daemon->group_gid = group != NULL ? group->gr_gid : 0;
+    daemon->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (daemon->listen_fd < 0)
+        return EXIT_FAILURE;
+    struct sockaddr_un addr;
+    socklen_t len = daemon_address(&addr);
+    // Only one daemon runs (it holds the instance socket), so any file
+    // here is left over from a crash
+    unlink(EC_DAEMON_SOCKET_PATH);
+    if (bind(daemon->listen_fd, (struct sockaddr*) &addr, len) != 0
+            || chmod(EC_DAEMON_SOCKET_PATH, 0666) != 0
+            || listen(daemon->listen_fd, EC_DAEMON_MAX_CLIENTS) != 0) {
+        int saved = errno;
+        close(daemon->listen_fd);
+        daemon->listen_fd = -1;
+        errno = saved;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int ec_daemon_accept(ec_daemon_t* daemon) {
+    int fd = accept4(daemon->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    for (int i = 0; i < EC_DAEMON_MAX_CLIENTS; i++) {
+        ec_daemon_client_t* client = &daemon->clients[i];
+        if (client->fd >= 0)
+            continue;
+        client->fd = fd;
+        client->subscribed = 0;
+        client->may_command = daemon_peer_may_command(daemon, fd);
+        return fd;
+    }
+    close(fd);
+    return -1;
+}
+
+int ec_daemon_serve(ec_daemon_t* daemon, int fd, const ec_telemetry_t* latest,
+        ec_command_t* command) {
+    ec_daemon_client_t* client = NULL;
+    for (int i = 0; i < EC_DAEMON_MAX_CLIENTS && client == NULL; i++) {
+        if (daemon->clients[i].fd == fd)
+            client = &daemon->clients[i];
+    }
+    if (client == NULL)
+        return 0;
+    ec_msg_t msg;
+    ssize_t n = recv(fd, &msg, sizeof(msg), 0);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        return 0;
+    if (n != sizeof(msg) || msg.version != EC_PROTO_VERSION) {
+        daemon_drop(client);
+        return -1;
+    }
+    switch (msg.type) {
+        case EC_MSG_SNAPSHOT:
+            daemon_send(fd, EC_MSG_SAMPLE, 0, latest);
+            return EC_MSG_SNAPSHOT;
+        case EC_MSG_SUBSCRIBE:
+            client->subscribed = 1;
+            if (latest->sequence > 0)
+                daemon_send(fd, EC_MSG_SAMPLE, 0, latest);
+            return EC_MSG_SUBSCRIBE;
+        case EC_MSG_COMMAND:
+            if (!client->may_command) {
+                ec_daemon_reply(fd, EPERM);
+                return 0;
+            }
+            *command = msg.body.command;
+            return EC_MSG_COMMAND;
+        default:
+            daemon_drop(client);
+            return -1;
+    }
+}
+
+void ec_daemon_reply(int fd, int status) {
+    daemon_send(fd, EC_MSG_REPLY, status, NULL);
+}
+
+void ec_daemon_broadcast(ec_daemon_t* daemon, const ec_telemetry_t* sample) {
+    for (int i = 0; i < EC_DAEMON_MAX_CLIENTS; i++) {
+        ec_daemon_client_t* client = &daemon->clients[i];
+        if (client->fd >= 0 && client->subscribed
+                && daemon_send(client->fd, EC_MSG_SAMPLE, 0, sample) != EXIT_SUCCESS)
+            daemon_drop(client);
+    }
+}
+
+void ec_daemon_close(ec_daemon_t* daemon) {
+    for (int i = 0; i < EC_DAEMON_MAX_CLIENTS; i++) {
+        if (daemon->clients[i].fd >= 0)
+            daemon_drop(&daemon->clients[i]);
+    }
+    if (daemon->listen_fd >= 0) {
+        close(daemon->listen_fd);
+        unlink(EC_DAEMON_SOCKET_PATH);
+    }
+    daemon->listen_fd = -1;
+}
+
+int ec_client_connect(void) {
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    struct sockaddr_un addr;
+    socklen_t len = daemon_address(&addr);
+    if (connect(fd, (struct sockaddr*) &addr, len) != 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+static int client_request(int fd, uint8_t type, const ec_command_t* command) {
+    ec_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.version = EC_PROTO_VERSION;
+    msg.type = type;
+    if (command != NULL)
+        msg.body.command = *command;
+    return send(fd, &msg, sizeof(msg), MSG_NOSIGNAL) == sizeof(msg) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Wait for the next message of the given type, skipping pushed samples
+static int client_receive(int fd, uint8_t type, int timeout_ms, ec_msg_t* msg) {
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    for (;;) {
+        if (timeout_ms >= 0 && poll(&pfd, 1, timeout_ms) <= 0) {
+            errno = ETIMEDOUT;
+            return EXIT_FAILURE;
+        }
+        ssize_t n = recv(fd, msg, sizeof(*msg), 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n != sizeof(*msg) || msg->version != EC_PROTO_VERSION) {
+            errno = n == 0 ? ECONNRESET : EPROTO;
+            return EXIT_FAILURE;
+        }
+        if (msg->type == type)
+            return EXIT_SUCCESS;
+    }
+}
+
+int ec_client_snapshot(int fd, ec_telemetry_t* sample) {
+    ec_msg_t msg;
+    if (client_request(fd, EC_MSG_SNAPSHOT, NULL) != EXIT_SUCCESS
+            || client_receive(fd, EC_MSG_SAMPLE, EC_CLIENT_TIMEOUT_MS, &msg) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    *sample = msg.body.sample;
+    return EXIT_SUCCESS;
+}
+
+int ec_client_subscribe(int fd) {
+    return client_request(fd, EC_MSG_SUBSCRIBE, NULL);
+}
+
+int ec_client_next(int fd, ec_telemetry_t* sample) {
+    ec_msg_t msg;
+    if (client_receive(fd, EC_MSG_SAMPLE, -1, &msg) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    *sample = msg.body.sample;
+    return EXIT_SUCCESS;
+}
+
+int ec_client_command(ec_command_type_t type, int32_t value) {
+    int fd = ec_client_connect();
+    if (fd < 0)
+        return EXIT_FAILURE;
+    ec_command_t command = {
+            .type = type,
+            .value = value,
+            .issued_ns = ec_stats_now_ns()
+    };
+    ec_msg_t msg;
+    int result = client_request(fd, EC_MSG_COMMAND, &command);
+    if (result == EXIT_SUCCESS)
+        result = client_receive(fd, EC_MSG_REPLY, EC_CLIENT_TIMEOUT_MS, &msg);
+    close(fd);
+    if (result != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    if (msg.status != 0) {
+        errno = msg.status;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,100 @@
+#ifndef EC_DAEMON_H
+#define EC_DAEMON_H
+
+#include "ec_command.h"
+#include "ec_telemetry.h"
+#include <sys/types.h>
+
+// `clevo-indicator --daemon` owns the EC and serves everyone else over a
+// SOCK_SEQPACKET UNIX socket: one sampler, any number of unprivileged
+// clients. Every message is one ec_msg_t datagram in host byte order.
+#ifndef EC_DAEMON_SOCKET_PATH
+#define EC_DAEMON_SOCKET_PATH "/run/clevo-indicator.sock"
+#endif
+
+// Anyone may read telemetry; commands need root or this group, the group
+// `make install` lets run the setuid binary
+#define EC_DAEMON_GROUP "adm"
+
+#define EC_DAEMON_MAX_CLIENTS 16
+#define EC_PROTO_VERSION 1
+
+typedef enum {
+    EC_MSG_SNAPSHOT = 1,    // client: send the latest sample
+    EC_MSG_SUBSCRIBE,       // client: push every new sample until I hang up
+    EC_MSG_COMMAND,         // client: apply body.command, answer with EC_MSG_REPLY
+    EC_MSG_SAMPLE,          // daemon: body.sample
+    EC_MSG_REPLY            // daemon: status is 0 or an errno value
+} ec_msg_type_t;
+
+typedef struct {
+    uint8_t version;        // EC_PROTO_VERSION
+    uint8_t type;           // ec_msg_type_t
+    uint16_t reserved;
+    int32_t status;
+    union {
+        ec_command_t command;
+        ec_telemetry_t sample;
+    } body;
+} ec_msg_t;
+
+typedef struct {
+    int fd;                 // -1 for a free slot
+    int subscribed;
+    int may_command;
+} ec_daemon_client_t;
+
+typedef struct {
+    int listen_fd;
+    int has_group;          // EC_DAEMON_GROUP exists
+    gid_t group_gid;        // its gid, looked up once by ec_daemon_listen()
+    ec_daemon_client_t clients[EC_DAEMON_MAX_CLIENTS];
+} ec_daemon_t;
+
+// Daemon: create the socket, replacing a stale one, and resolve
+// EC_DAEMON_GROUP so accepting never waits on NSS. EXIT_SUCCESS or
+// EXIT_FAILURE with errno set.
+int ec_daemon_listen(ec_daemon_t* daemon);
+
+// Daemon: accept a pending client. Returns its descriptor for the caller's
+// event loop, -1 if there was none or the table is full. Whether it may
+// send commands comes from the credentials and groups the kernel recorded
+// when it connected.
+int ec_daemon_accept(ec_daemon_t* daemon);
+
+// Daemon: serve one request from client fd. Snapshots and subscriptions are
+// answered from latest; a command is copied to *command and returns
+// EC_MSG_COMMAND, and the caller must ec_daemon_reply() once it is applied.
+// Returns 0 if fd is not a client, -1 after a hang-up or protocol error
+// (the client is dropped).
+int ec_daemon_serve(ec_daemon_t* daemon, int fd, const ec_telemetry_t* latest,
+        ec_command_t* command);
+
+// Daemon: answer a command with 0 or an errno value
+void ec_daemon_reply(int fd, int status);
+
+// Daemon: push a sample to every subscriber; one that cannot keep up is
+// dropped rather than stalling the sampler
+void ec_daemon_broadcast(ec_daemon_t* daemon, const ec_telemetry_t* sample);
+
+// Daemon: drop every client and remove the socket
+void ec_daemon_close(ec_daemon_t* daemon);
+
+// Client: connect to the daemon, -1 if none is running
+int ec_client_connect(void);
+
+// Client: fetch the latest sample. EXIT_SUCCESS or EXIT_FAILURE.
+int ec_client_snapshot(int fd, ec_telemetry_t* sample);
+
+// Client: ask for every new sample. EXIT_SUCCESS or EXIT_FAILURE.
+int ec_client_subscribe(int fd);
+
+// Client: wait for the next pushed sample; EXIT_FAILURE when the daemon
+// went away
+int ec_client_next(int fd, ec_telemetry_t* sample);
+
+// Client: apply a command over a connection of its own. EXIT_SUCCESS, or
+// EXIT_FAILURE with errno set from the daemon's answer.
+int ec_client_command(ec_command_type_t type, int32_t value);
+
+#endif // EC_DAEMON_H
@@ -0,0 +1,177 @@
+#define _GNU_SOURCE // accept4, struct ucred
+#include "ec_instance.h"
+#include "ec_stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Desktop user of the instance; the process may be root by the time it
+// receives commands
+static uid_t owner_uid = 0;
+
+// Senders accepted but not served yet, -1 for a free slot
+static int senders[EC_INSTANCE_MAX_SENDERS];
+static uint64_t sender_since_ns[EC_INSTANCE_MAX_SENDERS];
+
+static socklen_t instance_address(struct sockaddr_un* addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    // Leading NUL: abstract namespace, no file to create or remove
+    size_t len = strlen(EC_INSTANCE_NAME);
+    memcpy(addr->sun_path + 1, EC_INSTANCE_NAME, len);
+    return offsetof(struct sockaddr_un, sun_path) + 1 + len;
+}
+
+static void instance_set_timeout(int fd, int timeout_ms) {
+    struct timeval tv = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+int ec_instance_claim(void) {
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    struct sockaddr_un addr;
+    socklen_t len = instance_address(&addr);
+    if (bind(fd, (struct sockaddr*) &addr, len) != 0 || listen(fd, 4) != 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    owner_uid = getuid();
+    for (int i = 0; i < EC_INSTANCE_MAX_SENDERS; i++)
+        senders[i] = -1;
+    return fd;
+}
+
+static void instance_answer(int fd, int32_t reply) {
+    send(fd, &reply, sizeof(reply), MSG_DONTWAIT | MSG_NOSIGNAL);
+    close(fd);
+}
+
+// Connect to whoever holds the instance name. Any local user can bind
+// it, so only a holder running as root or as ourselves is believed;
+// anyone else fails with EACCES. Returns the socket or -1.
+static int instance_connect(void) {
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    instance_set_timeout(fd, EC_INSTANCE_TIMEOUT_MS);
+    struct sockaddr_un addr;
+    socklen_t len = instance_address(&addr);
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    int saved = 0;
+    if (connect(fd, (struct sockaddr*) &addr, len) != 0
+            || getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) != 0)
+        saved = errno;
+    else if (cred.uid != 0 && cred.uid != getuid())
+        saved = EACCES;
+    if (saved != 0) {
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+int ec_instance_trusted(void) {
+    int fd = instance_connect();
+    if (fd < 0)
+        return 0;
+    close(fd);
+    return 1;
+}
+
+int ec_instance_forward(ec_command_type_t type, int32_t value) {
+    int fd = instance_connect();
+    if (fd < 0)
+        return EXIT_FAILURE;
+    ec_command_t command = {
+            .type = type,
+            .value = value,
+            .issued_ns = ec_stats_now_ns()
+    };
+    int32_t reply = EXIT_FAILURE;
+    if (send(fd, &command, sizeof(command), MSG_NOSIGNAL) != sizeof(command)
+            || recv(fd, &reply, sizeof(reply), 0) != sizeof(reply)) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return EXIT_FAILURE;
+    }
+    close(fd);
+    if (reply != EXIT_SUCCESS)
+        errno = EPERM;
+    return reply == EXIT_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int ec_instance_accept(int listen_fd) {
+    int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) != 0
+            || (cred.uid != owner_uid && cred.uid != 0)) {
+        instance_answer(fd, EXIT_FAILURE);
+        return -1;
+    }
+    // A sender that never writes only holds its slot until the timeout
+    uint64_t now = ec_stats_now_ns();
+    int slot = -1;
+    for (int i = 0; i < EC_INSTANCE_MAX_SENDERS; i++) {
+        if (senders[i] >= 0
+                && now - sender_since_ns[i] > (uint64_t) EC_INSTANCE_TIMEOUT_MS * 1000000ULL) {
+            instance_answer(senders[i], EXIT_FAILURE);
+            senders[i] = -1;
+        }
+        if (senders[i] < 0 && slot < 0)
+            slot = i;
+    }
+    if (slot < 0) {
+        instance_answer(fd, EXIT_FAILURE);
+        return -1;
+    }
+    senders[slot] = fd;
+    sender_since_ns[slot] = now;
+    return fd;
+}
+
+int ec_instance_serve(int fd, ec_command_t* command) {
+    int slot = -1;
+    for (int i = 0; i < EC_INSTANCE_MAX_SENDERS && slot < 0; i++) {
+        if (senders[i] == fd && fd >= 0)
+            slot = i;
+    }
+    if (slot < 0)
+        return 0;
+    ssize_t n = recv(fd, command, sizeof(*command), 0);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        return 0;
+    senders[slot] = -1;
+    if (n != sizeof(*command)
+            || command->type < EC_COMMAND_SET_DUTY || command->type > EC_COMMAND_SET_TARGET) {
+        instance_answer(fd, EXIT_FAILURE);
+        return -1;
+    }
+    instance_answer(fd, EXIT_SUCCESS);
+    return 1;
+}
+
+int ec_instance_pending(int* fds) {
+    int count = 0;
+    for (int i = 0; i < EC_INSTANCE_MAX_SENDERS; i++) {
+        if (senders[i] >= 0)
+            fds[count++] = senders[i];
+    }
+    return count;
+}
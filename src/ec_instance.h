@@ -0,0 +1,49 @@
+#ifndef EC_INSTANCE_H
+#define EC_INSTANCE_H
+
+#include "ec_command.h"
+
+// Single-instance guard: the running instance holds an abstract UNIX socket
+// bound to this name. The kernel releases it when the last holder exits, so
+// there is nothing stale to clean up and claiming costs one bind().
+#ifndef EC_INSTANCE_NAME
+#define EC_INSTANCE_NAME "clevo-indicator"
+#endif
+
+// Give up on an instance that does not answer a forwarded command, and
+// on a sender that connects but does not write
+#define EC_INSTANCE_TIMEOUT_MS 1000
+
+// Senders the running instance keeps waiting on at once
+#define EC_INSTANCE_MAX_SENDERS 4
+
+// Claim the instance. Returns the listening socket, or -1 with errno set
+// to EADDRINUSE when another instance runs.
+int ec_instance_claim(void);
+
+// 1 if the instance name is held by root or by the calling user, 0 (with
+// errno set) if someone else squats it or nobody answers
+int ec_instance_trusted(void);
+
+// Hand a command to the running instance, stamped with the current time.
+// EXIT_SUCCESS once the instance has accepted it. Fails with EACCES
+// without sending anything if the holder is neither root nor the caller.
+int ec_instance_forward(ec_command_type_t type, int32_t value);
+
+// Accept a sender on the listening socket. Only the user that claimed the
+// instance and root may send commands; anyone else is answered and
+// dropped here. Returns the sender's nonblocking descriptor for the
+// caller's event loop, or -1.
+int ec_instance_accept(int listen_fd);
+
+// Read a sender's command without blocking. Returns 1 with *command set
+// once it is accepted, 0 if fd is not a waiting sender or it has not
+// written yet, -1 if it sent garbage. The sender is answered and its
+// descriptor closed unless 0 is returned.
+int ec_instance_serve(int fd, ec_command_t* command);
+
+// Descriptors of senders still waiting, at most EC_INSTANCE_MAX_SENDERS;
+// returns how many
+int ec_instance_pending(int* fds);
+
+#endif // EC_INSTANCE_H
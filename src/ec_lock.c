@@ -0,0 +1,159 @@
+#include "ec_lock.h"
+#include "ec_stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int lock_fd = -1;
+static pid_t lock_pid = 0;
+static int lock_held = 0;
+static const char* lock_path = EC_LOCK_PATH;
+static unsigned int lock_timeout_ms = EC_LOCK_TIMEOUT_MS;
+
+// Only a file we (or root) own and others cannot open is a lock nobody
+// else can squat on
+static int lock_trusted(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+        return 0;
+    return (st.st_uid == 0 || st.st_uid == geteuid()) && (st.st_mode & 0007) == 0;
+}
+
+// Create the lock file, shared with EC_LOCK_GROUP when we are root
+static int lock_create(const char* path) {
+    int fd = open(path, O_RDONLY | O_CREAT | O_EXCL | O_CLOEXEC | O_NOFOLLOW, EC_LOCK_MODE);
+    if (fd < 0)
+        return -1;
+    // Let capability-based instances in the group share it. Without
+    // CAP_CHOWN they cannot open it and will refuse port I/O; say why.
+    if (geteuid() == 0) {
+        struct group* group = getgrnam(EC_LOCK_GROUP);
+        if (group == NULL || fchown(fd, 0, group->gr_gid) != 0)
+            printf("Warning: cannot hand %s to group %s: %s\n", path, EC_LOCK_GROUP,
+                    group == NULL ? "no such group" : strerror(errno));
+    }
+    fchmod(fd, EC_LOCK_MODE);
+    return fd;
+}
+
+// Open the lock file, creating it if needed. Fails with EACCES if someone
+// else could hold it and it cannot be replaced.
+static int lock_open(const char* path) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        int fd = open(path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+        if (fd >= 0) {
+            if (lock_trusted(fd))
+                return fd;
+            // Planted or left world-readable by an older version. Only root
+            // may replace it, and only while holding it, so nobody still
+            // using it is mid-transaction; they notice in ec_lock_acquire().
+            int replaced = geteuid() == 0 && flock(fd, LOCK_EX | LOCK_NB) == 0
+                    && unlink(path) == 0;
+            close(fd);
+            if (!replaced) {
+                errno = EACCES;
+                return -1;
+            }
+        } else if (errno != ENOENT) {
+            return -1;
+        }
+        fd = lock_create(path);
+        // Lost a race with another instance creating it: check theirs
+        if (fd >= 0 || errno != EEXIST)
+            return fd;
+    }
+    return -1;
+}
+
+// Whether fd still is the file at the lock path, i.e. was not replaced
+static int lock_current(int fd, const char* path) {
+    struct stat held, named;
+    return fstat(fd, &held) == 0 && stat(path, &named) == 0
+            && held.st_dev == named.st_dev && held.st_ino == named.st_ino;
+}
+
+// flock() locks belong to the open file description, which a forked
+// child shares with its parent, so every process opens its own
+static int lock_get_fd(void) {
+    if (lock_fd >= 0 && lock_pid == getpid())
+        return lock_fd;
+    if (lock_fd >= 0)
+        close(lock_fd);
+    lock_path = EC_LOCK_PATH;
+    lock_fd = lock_open(lock_path);
+    if (lock_fd < 0 && errno != EACCES) {
+        lock_path = EC_LOCK_FALLBACK_PATH;
+        lock_fd = lock_open(lock_path);
+    }
+    lock_pid = getpid();
+    lock_held = 0;
+    return lock_fd;
+}
+
+// flock() with a bounded wait
+static int lock_wait(int fd) {
+    ec_lock_stats_t* stats = &ec_stats_get()->lock;
+    if (flock(fd, LOCK_EX | LOCK_NB) == 0)
+        return EXIT_SUCCESS;
+
+    // Someone else is mid-transaction: wait with a short backoff
+    stats->contended++;
+    uint64_t start = ec_stats_now_ns();
+    uint64_t deadline = start + (uint64_t) lock_timeout_ms * 1000000ULL;
+    unsigned int sleep_us = 50;
+    while (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        if ((errno != EWOULDBLOCK && errno != EINTR) || ec_stats_now_ns() >= deadline) {
+            stats->timeouts++;
+            return EXIT_FAILURE;
+        }
+        usleep(sleep_us);
+        if (sleep_us < 2000)
+            sleep_us *= 2;
+    }
+    ec_histogram_record(&stats->wait, ec_stats_now_ns() - start);
+    return EXIT_SUCCESS;
+}
+
+int ec_lock_acquire(void) {
+    ec_lock_stats_t* stats = &ec_stats_get()->lock;
+    stats->acquisitions++;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        int fd = lock_get_fd();
+        if (fd < 0) {
+            // No lock file we can trust: refuse rather than run unserialized
+            int saved = errno;
+            if (stats->refused++ == 0)
+                printf("Warning: no usable EC bus lock, refusing port I/O: %s\n", strerror(saved));
+            errno = saved;
+            return EXIT_FAILURE;
+        }
+        if (lock_wait(fd) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+        if (lock_current(fd, lock_path)) {
+            lock_held = 1;
+            return EXIT_SUCCESS;
+        }
+        // Root replaced an untrusted file after we opened it
+        close(lock_fd);
+        lock_fd = -1;
+    }
+    errno = EAGAIN;
+    return EXIT_FAILURE;
+}
+
+void ec_lock_set_timeout(unsigned int timeout_ms) {
+    lock_timeout_ms = timeout_ms;
+}
+
+void ec_lock_release(void) {
+    if (lock_fd >= 0 && lock_held && lock_pid == getpid()) {
+        flock(lock_fd, LOCK_UN);
+        lock_held = 0;
+    }
+}
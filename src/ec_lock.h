@@ -0,0 +1,38 @@
+#ifndef EC_LOCK_H
+#define EC_LOCK_H
+
+// Advisory lock shared by every clevo-indicator process touching the EC
+// ports, so a one-shot `clevo-indicator 80` cannot interleave its handshake
+// with a running worker. Held for a whole batch, write or snapshot.
+//
+// flock() only needs a readable descriptor, so the file is root-owned and
+// readable by EC_LOCK_GROUP alone; anyone else could hold it forever and
+// starve the fan controller.
+#ifndef EC_LOCK_PATH
+#define EC_LOCK_PATH "/run/lock/clevo-indicator-ec.lock"
+#endif
+#ifndef EC_LOCK_FALLBACK_PATH
+#define EC_LOCK_FALLBACK_PATH "/tmp/clevo-indicator-ec.lock"
+#endif
+#define EC_LOCK_MODE 0640
+#define EC_LOCK_GROUP "adm"
+
+// Give up waiting for another process after this long
+#define EC_LOCK_TIMEOUT_MS 5000
+
+// The worker would rather skip a tick than wait most of a period
+#define EC_LOCK_WORKER_TIMEOUT_MS 20
+
+// Take the bus lock, EXIT_SUCCESS or EXIT_FAILURE on timeout. Also fails,
+// warning once, if no trustworthy lock file can be opened or created.
+// Root replaces an untrusted file, but only while holding its lock.
+int ec_lock_acquire(void);
+
+// How long ec_lock_acquire() waits for another process (default
+// EC_LOCK_TIMEOUT_MS)
+void ec_lock_set_timeout(unsigned int timeout_ms);
+
+// Release the bus lock
+void ec_lock_release(void);
+
+#endif // EC_LOCK_H
@@ -0,0 +1,180 @@
+#include "ec_loop.h"
+#include "ec_stats.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+int ec_loop_wake_fd(void) {
+    return eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+}
+
+void ec_loop_wake(int wake_fd) {
+    if (wake_fd < 0)
+        return;
+    uint64_t one = 1;
+    ssize_t written = write(wake_fd, &one, sizeof(one));
+    (void) written; // a saturated counter still wakes the loop
+}
+
+static int loop_watch(ec_loop_t* loop, int fd) {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    return epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+int ec_loop_open(ec_loop_t* loop, int wake_fd, const sigset_t* signals) {
+    memset(loop, 0, sizeof(*loop));
+    loop->timer_fd = -1;
+    loop->signal_fd = -1;
+    loop->wake_fd = wake_fd;
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd < 0)
+        return EXIT_FAILURE;
+
+    loop->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (loop->timer_fd < 0 || loop_watch(loop, loop->timer_fd) != 0)
+        goto fail;
+    if (signals != NULL) {
+        if (sigprocmask(SIG_BLOCK, signals, NULL) != 0)
+            goto fail;
+        loop->signal_fd = signalfd(-1, signals, SFD_CLOEXEC | SFD_NONBLOCK);
+        if (loop->signal_fd < 0 || loop_watch(loop, loop->signal_fd) != 0)
+            goto fail;
+    }
+    if (wake_fd >= 0 && loop_watch(loop, wake_fd) != 0)
+        goto fail;
+    return ec_loop_set_period(loop, EC_LOOP_DEFAULT_PERIOD_MS);
+
+fail:
+    ec_loop_close(loop);
+    return EXIT_FAILURE;
+}
+
+int ec_loop_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+    return (int) syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void) pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+int ec_loop_add_fd(ec_loop_t* loop, int fd) {
+    return loop_watch(loop, fd) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int ec_loop_set_period(ec_loop_t* loop, unsigned int period_ms) {
+    if (period_ms == loop->period_ms)
+        return EXIT_SUCCESS;
+    uint64_t period_ns = (uint64_t) period_ms * 1000000ULL;
+    uint64_t now = ec_stats_now_ns();
+    uint64_t first_ns = now + period_ns;
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = period_ms / 1000;
+    spec.it_interval.tv_nsec = (long) (period_ms % 1000) * 1000000L;
+    spec.it_value = spec.it_interval;
+    int flags = 0;
+    if (loop->aligned && period_ns > 0) {
+        // First expiration on the next multiple of the period
+        first_ns = (now / period_ns + 1) * period_ns;
+        spec.it_value.tv_sec = (time_t) (first_ns / 1000000000ULL);
+        spec.it_value.tv_nsec = (long) (first_ns % 1000000000ULL);
+        flags = TFD_TIMER_ABSTIME;
+    }
+    if (timerfd_settime(loop->timer_fd, flags, &spec, NULL) != 0)
+        return EXIT_FAILURE;
+    loop->period_ms = period_ms;
+    loop->next_tick_ns = first_ns;
+    ec_stats_get()->loop.period_ms = period_ms;
+    return EXIT_SUCCESS;
+}
+
+int ec_loop_align(ec_loop_t* loop, int enabled) {
+    unsigned int period_ms = loop->period_ms;
+    loop->aligned = enabled != 0;
+    loop->period_ms = 0;  // force the timer to be re-armed
+    return ec_loop_set_period(loop, period_ms);
+}
+
+int ec_loop_wait(ec_loop_t* loop) {
+    ec_loop_stats_t* stats = &ec_stats_get()->loop;
+    struct epoll_event events[EC_LOOP_MAX_EVENTS];
+    int n;
+    do {
+        n = epoll_wait(loop->epoll_fd, events, EC_LOOP_MAX_EVENTS, -1);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0)
+        return -1;
+
+    stats->wakeups++;
+    loop->ready_count = 0;
+    loop->due_ns = ec_stats_now_ns();
+    int mask = 0;
+    for (int i = 0; i < n; i++) {
+        int fd = events[i].data.fd;
+        if (fd == loop->timer_fd) {
+            uint64_t expirations = 0;
+            if (read(fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+                stats->timer_wakeups++;
+                if (expirations > 1)
+                    stats->missed_ticks += expirations - 1;
+                // How late we woke for the most recent expiration
+                uint64_t period_ns = (uint64_t) loop->period_ms * 1000000ULL;
+                uint64_t due_ns = loop->next_tick_ns + (expirations - 1) * period_ns;
+                uint64_t now = ec_stats_now_ns();
+                ec_histogram_record(&stats->jitter, now > due_ns ? now - due_ns : 0);
+                loop->next_tick_ns = due_ns + period_ns;
+                loop->due_ns = due_ns;
+            }
+            mask |= EC_LOOP_TIMER;
+        } else if (fd == loop->wake_fd) {
+            uint64_t count = 0;
+            if (read(fd, &count, sizeof(count)) == sizeof(count))
+                stats->commands++;
+            mask |= EC_LOOP_WAKE;
+        } else if (fd == loop->signal_fd) {
+            struct signalfd_siginfo info;
+            if (read(fd, &info, sizeof(info)) == sizeof(info))
+                loop->last_signal = (int) info.ssi_signo;
+            stats->signals++;
+            mask |= EC_LOOP_SIGNAL;
+        } else {
+            loop->last_fd = fd;
+            loop->ready_fds[loop->ready_count++] = fd;
+            mask |= EC_LOOP_FD;
+        }
+    }
+    return mask;
+}
+
+void ec_loop_close(ec_loop_t* loop) {
+    if (loop->signal_fd >= 0) close(loop->signal_fd);
+    if (loop->timer_fd >= 0) close(loop->timer_fd);
+    if (loop->epoll_fd >= 0) close(loop->epoll_fd);
+    loop->signal_fd = -1;
+    loop->timer_fd = -1;
+    loop->epoll_fd = -1;
+}
+
+unsigned int ec_loop_adapt_period(unsigned int period_ms, int temp, int prev_temp,
+        int target) {
+    // Heating up or close to the target: react as fast as we can
+    if (temp - prev_temp >= EC_LOOP_TREND_C || temp >= target - EC_LOOP_NEAR_TARGET_C)
+        return EC_LOOP_MIN_PERIOD_MS;
+    // Cooling down: the controller is backing off, a moderate pace will do
+    if (prev_temp - temp >= EC_LOOP_TREND_C)
+        return period_ms < EC_LOOP_DEFAULT_PERIOD_MS ? EC_LOOP_DEFAULT_PERIOD_MS : period_ms;
+    // Idle and stable: back off geometrically
+    unsigned int next = period_ms + period_ms / 2;
+    return next > EC_LOOP_MAX_PERIOD_MS ? EC_LOOP_MAX_PERIOD_MS : next;
+}
@@ -0,0 +1,87 @@
+#ifndef EC_LOOP_H
+#define EC_LOOP_H
+
+#include <signal.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Sample period bounds for the worker. Hot or heating up means sampling at
+// the minimum; idle and stable lets the period stretch towards the maximum.
+#define EC_LOOP_MIN_PERIOD_MS 100
+#define EC_LOOP_DEFAULT_PERIOD_MS 200
+#define EC_LOOP_MAX_PERIOD_MS 2000
+
+// An iteration done later than this after its tick was due misses its deadline
+#define EC_LOOP_DEFAULT_SLO_MS 50
+
+// Within this many °C of the target counts as near the target
+#define EC_LOOP_NEAR_TARGET_C 3
+
+// A change smaller than this many °C is EC jitter, not a trend
+#define EC_LOOP_TREND_C 2
+
+// What woke ec_loop_wait(), as a bit mask
+#define EC_LOOP_TIMER 0x1    // the sample period elapsed
+#define EC_LOOP_WAKE 0x2     // another process rang the wake eventfd
+#define EC_LOOP_SIGNAL 0x4   // a termination signal arrived
+#define EC_LOOP_FD 0x8       // a watched descriptor became readable
+
+// Most events handled per wakeup; the rest stay pending for the next wait
+#define EC_LOOP_MAX_EVENTS 16
+
+// Worker event loop: epoll over a timerfd for the sample period, a
+// signalfd for termination signals and an eventfd other processes ring
+// to hand the worker a command without waiting for the next tick
+typedef struct {
+    int epoll_fd;
+    int timer_fd;
+    int signal_fd;
+    int wake_fd;
+    unsigned int period_ms;
+    int last_signal;      // signal number behind the last EC_LOOP_SIGNAL
+    int last_fd;          // descriptor behind the last EC_LOOP_FD
+    int ready_fds[EC_LOOP_MAX_EVENTS]; // every watched descriptor behind EC_LOOP_FD
+    int ready_count;
+    uint64_t next_tick_ns;  // CLOCK_MONOTONIC of the next timer expiration
+    int aligned;            // expirations land on multiples of the period
+    uint64_t due_ns;        // when the work of the last wakeup became due: the
+                            // timer expiration, or the wakeup itself
+} ec_loop_t;
+
+// Create the wake eventfd; do this before forking the processes sharing it
+int ec_loop_wake_fd(void);
+
+// Ring the wake eventfd
+void ec_loop_wake(int wake_fd);
+
+// Set up the loop, blocking `signals` so they arrive through the signalfd.
+// EXIT_SUCCESS or EXIT_FAILURE.
+int ec_loop_open(ec_loop_t* loop, int wake_fd, const sigset_t* signals);
+
+// pidfd that becomes readable when `pid` exits, -1 if the kernel has none
+int ec_loop_pidfd(pid_t pid);
+
+// Watch an extra descriptor for readability
+int ec_loop_add_fd(ec_loop_t* loop, int fd);
+
+// Re-arm the periodic timer if the period changed
+int ec_loop_set_period(ec_loop_t* loop, unsigned int period_ms);
+
+// Arm the timer on multiples of the period on CLOCK_MONOTONIC, so loops
+// in other processes with periods on the same grid wake together
+int ec_loop_align(ec_loop_t* loop, int enabled);
+
+// Block until something happens; returns the EC_LOOP_* mask, -1 on error
+int ec_loop_wait(ec_loop_t* loop);
+
+// Close the loop's descriptors (not the wake fd, which it does not own)
+void ec_loop_close(ec_loop_t* loop);
+
+// Next sample period from the hottest temperature, its change since
+// `prev_temp` and the controller target. Changes under EC_LOOP_TREND_C
+// count as stable, so the caller should keep `prev_temp` until the
+// temperature has moved that far rather than update it every sample.
+unsigned int ec_loop_adapt_period(unsigned int period_ms, int temp, int prev_temp,
+        int target);
+
+#endif // EC_LOOP_H
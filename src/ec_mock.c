@@ -0,0 +1,69 @@
+#include "ec_backend.h"
+#include <stdlib.h>
+#include <string.h>
+
+// In-memory register file for running the real worker loop without hardware
+typedef struct {
+    ec_backend_t base;
+    uint8_t regs[EC_REG_SIZE];
+} ec_mock_backend_t;
+
+static int mock_read_batch(ec_backend_t* backend, const uint8_t* regs,
+        uint8_t* out, size_t n) {
+    ec_mock_backend_t* mb = (ec_mock_backend_t*) backend;
+    for (size_t i = 0; i < n; i++)
+        out[i] = mb->regs[regs[i]];
+    return EXIT_SUCCESS;
+}
+
+static int mock_write(ec_backend_t* backend, uint8_t cmd, uint8_t port,
+        uint8_t value) {
+    ec_mock_backend_t* mb = (ec_mock_backend_t*) backend;
+    if (cmd != EC_CMD_FAN_DUTY || port != EC_FAN_DUTY_PORT)
+        return EXIT_FAILURE;
+    mb->regs[EC_REG_FAN_DUTY] = value;
+    return EXIT_SUCCESS;
+}
+
+static int mock_snapshot(ec_backend_t* backend, uint8_t* regs) {
+    ec_mock_backend_t* mb = (ec_mock_backend_t*) backend;
+    memcpy(regs, mb->regs, EC_REG_SIZE);
+    return EXIT_SUCCESS;
+}
+
+static ec_health_t mock_health(ec_backend_t* backend) {
+    return EC_HEALTH_OK;
+}
+
+static void mock_close(ec_backend_t* backend) {
+    free(backend);
+}
+
+static const ec_backend_ops_t mock_ops = {
+        .read_batch = mock_read_batch,
+        .write = mock_write,
+        .snapshot = mock_snapshot,
+        .health = mock_health,
+        .close = mock_close
+};
+
+void ec_mock_set_register(ec_backend_t* backend, uint8_t reg, uint8_t value) {
+    if (backend == NULL || backend->ops != &mock_ops)
+        return;
+    ((ec_mock_backend_t*) backend)->regs[reg] = value;
+}
+
+ec_backend_t* ec_mock_open(void) {
+    ec_mock_backend_t* mb = calloc(1, sizeof(*mb));
+    if (mb == NULL)
+        return NULL;
+    mb->base.ops = &mock_ops;
+    mb->base.type = EC_BACKEND_MOCK;
+    // Plausible idle laptop: 45°C CPU, 50°C GPU, 60% duty, ~2000 RPM
+    mb->regs[EC_REG_CPU_TEMP] = 45;
+    mb->regs[EC_REG_GPU_TEMP] = 50;
+    mb->regs[EC_REG_FAN_DUTY] = 60 * 255 / 100;
+    mb->regs[EC_REG_FAN_RPMS_HI] = (2156220 / 2000) >> 8;
+    mb->regs[EC_REG_FAN_RPMS_LO] = (2156220 / 2000) & 0xFF;
+    return &mb->base;
+}
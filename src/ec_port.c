@@ -0,0 +1,350 @@
+#include "ec_backend.h"
+#include "ec_lock.h"
+#include "ec_stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/io.h>
+#include <unistd.h>
+
+#define EC_SC 0x66
+#define EC_DATA 0x62
+
+#define IBF 1
+#define OBF 0
+#define EC_SC_READ_CMD 0x80
+
+// Consecutive failed transactions before the bus is reported as failed
+#define EC_PORT_FAIL_LIMIT 3
+
+// No Clevo EC reports a temperature this high; a floating bus reads 0xFF
+#define EC_PORT_MAX_PLAUSIBLE_TEMP 120
+
+// Port I/O handshake, either through inb/outb (ioperm) or /dev/port
+typedef struct {
+    ec_backend_t base;
+    int devport_fd;
+    unsigned int consecutive_failures;
+    int last_failed;
+    uint64_t cooldown_until_ns;   // transactions fail fast until then
+    uint32_t jitter;              // xorshift state for retry backoff
+} ec_port_backend_t;
+
+static ec_wait_config_t wait_config = {
+        .spin_us = 50,
+        .sleep_min_us = 20,
+        .sleep_max_us = 1000,
+        .timeout_us = 20000,
+        .step_retries = 2,
+        .retry_backoff_us = 500,
+        .cooldown_ms = 1000,
+        .spin_iterations = 50,
+        .inb_ns = 0
+};
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __asm__ __volatile__("pause" ::: "memory");
+#endif
+}
+
+static inline uint8_t port_in(ec_port_backend_t* pb, uint16_t port) {
+    if (pb->devport_fd >= 0) {
+        uint8_t value = 0xFF;
+        if (pread(pb->devport_fd, &value, 1, port) != 1)
+            return 0xFF;
+        return value;
+    }
+    return inb(port);
+}
+
+static inline void port_out(ec_port_backend_t* pb, uint8_t value, uint16_t port) {
+    if (pb->devport_fd >= 0) {
+        ssize_t written = pwrite(pb->devport_fd, &value, 1, port);
+        (void) written; // a failed write shows up as a wait timeout
+        return;
+    }
+    outb(value, port);
+}
+
+// Measure what one status-register poll costs on this machine so the spin
+// phase of port_wait covers spin_us of wall time rather than a fixed count.
+static void port_calibrate_wait(ec_port_backend_t* pb) {
+    const int samples = 64;
+    uint64_t start = ec_stats_now_ns();
+    for (int i = 0; i < samples; i++) {
+        (void) port_in(pb, EC_SC);
+    }
+    uint64_t per_inb_ns = (ec_stats_now_ns() - start) / samples;
+    if (per_inb_ns == 0)
+        per_inb_ns = 1;
+    wait_config.inb_ns = per_inb_ns;
+    wait_config.spin_iterations =
+            (unsigned int) (wait_config.spin_us * 1000ULL / per_inb_ns);
+}
+
+static int port_wait(ec_port_backend_t* pb, const uint32_t port,
+        const uint32_t flag, const char value) {
+    ec_wait_stats_t* wait_stats = &ec_stats_get()->wait;
+    uint64_t start = ec_stats_now_ns();
+    uint8_t data = port_in(pb, port);
+    unsigned int spins = 0;
+
+    // IBF/OBF usually flips within microseconds, so poll before sleeping
+    while ((((data >> flag) & 0x1) != value)
+            && (spins++ < wait_config.spin_iterations)) {
+        cpu_relax();
+        data = port_in(pb, port);
+    }
+    wait_stats->waits++;
+    if (((data >> flag) & 0x1) == value) {
+        wait_stats->spin_hits++;
+        ec_histogram_record(&wait_stats->spin_latency, ec_stats_now_ns() - start);
+        return EXIT_SUCCESS;
+    }
+
+    uint64_t deadline = start + (uint64_t) wait_config.timeout_us * 1000ULL;
+    unsigned int sleep_us = wait_config.sleep_min_us;
+    while (((data >> flag) & 0x1) != value) {
+        uint64_t before_sleep = ec_stats_now_ns();
+        if (before_sleep >= deadline) {
+            wait_stats->timeouts++;
+            return EXIT_FAILURE;
+        }
+        usleep(sleep_us);
+        wait_stats->slept_ns += ec_stats_now_ns() - before_sleep;
+        sleep_us = sleep_us * 2 < wait_config.sleep_max_us
+                ? sleep_us * 2 : wait_config.sleep_max_us;
+        data = port_in(pb, port);
+    }
+    wait_stats->sleep_hits++;
+    ec_histogram_record(&wait_stats->sleep_latency, ec_stats_now_ns() - start);
+    return EXIT_SUCCESS;
+}
+
+static void port_track(ec_port_backend_t* pb, int failed) {
+    pb->last_failed = failed;
+    if (failed) {
+        pb->consecutive_failures++;
+    } else {
+        pb->consecutive_failures = 0;
+    }
+}
+
+// Exponential backoff with up to 100% jitter, so two processes that lost
+// the same handshake do not retry in lockstep
+static unsigned int port_backoff_us(ec_port_backend_t* pb, unsigned int attempt) {
+    unsigned int base = wait_config.retry_backoff_us << (attempt < 8 ? attempt : 8);
+    pb->jitter ^= pb->jitter << 13;
+    pb->jitter ^= pb->jitter >> 17;
+    pb->jitter ^= pb->jitter << 5;
+    return base + (base > 0 ? pb->jitter % base : 0);
+}
+
+// Wait for one handshake step, retrying only that wait when it times out
+static int port_step(ec_port_backend_t* pb, ec_op_t op, const uint32_t flag,
+        const char value, unsigned int* timeouts) {
+    for (unsigned int attempt = 0; ; attempt++) {
+        if (port_wait(pb, EC_SC, flag, value) == EXIT_SUCCESS)
+            return EXIT_SUCCESS;
+        (*timeouts)++;
+        if (attempt >= wait_config.step_retries)
+            return EXIT_FAILURE;
+        ec_stats_record_retry(op);
+        usleep(port_backoff_us(pb, attempt));
+    }
+}
+
+static int port_plausible(ec_port_backend_t* pb, uint8_t reg, uint8_t value) {
+    if ((reg == EC_REG_CPU_TEMP || reg == EC_REG_GPU_TEMP) && value > EC_PORT_MAX_PLAUSIBLE_TEMP)
+        return 0;
+    // 0xFF is a legitimate value for most registers, not with 0xFF status
+    return value != 0xFF || port_in(pb, EC_SC) != 0xFF;
+}
+
+static int port_cooling_down(ec_port_backend_t* pb) {
+    if (pb->cooldown_until_ns == 0)
+        return 0;
+    if (ec_stats_now_ns() < pb->cooldown_until_ns) {
+        ec_stats_record_txn(EC_TXN_COOLDOWN);
+        return 1;
+    }
+    pb->cooldown_until_ns = 0;
+    return 0;
+}
+
+// Account for a finished transaction; a failed one puts the bus into cooldown
+static int port_finish(ec_port_backend_t* pb, ec_op_t op, uint64_t start,
+        ec_txn_result_t result, unsigned int timeouts, unsigned int attempts, uint8_t reg) {
+    int failed = result != EC_TXN_OK;
+    if (!failed && (timeouts > 0 || attempts > 0))
+        result = EC_TXN_RECOVERED;
+    ec_stats_record_txn(result);
+    // command + register out, value in; recovered steps are not errors
+    ec_stats_record(op, ec_stats_now_ns() - start, 3, failed ? timeouts : 0);
+    if (failed && timeouts == 0)
+        ec_stats_record_error(op);
+    port_track(pb, failed);
+    if (failed) {
+        pb->cooldown_until_ns = ec_stats_now_ns() + (uint64_t) wait_config.cooldown_ms * 1000000ULL;
+        printf("EC %s of 0x%02X failed: %s, cooling down for %u ms\n",
+                ec_op_name(op), reg, ec_txn_result_name(result), wait_config.cooldown_ms);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+static int port_read(ec_port_backend_t* pb, const uint8_t reg, uint8_t* out) {
+    if (port_cooling_down(pb))
+        return EXIT_FAILURE;
+    uint64_t start = ec_stats_now_ns();
+    unsigned int timeouts = 0;
+    ec_txn_result_t result = EC_TXN_OK;
+    unsigned int attempt = 0;
+
+    for (;; attempt++) {
+        if (port_step(pb, EC_OP_READ, IBF, 0, &timeouts) != EXIT_SUCCESS) {
+            result = EC_TXN_IBF_STUCK;
+            break;
+        }
+        port_out(pb, EC_SC_READ_CMD, EC_SC);
+
+        if (port_step(pb, EC_OP_READ, IBF, 0, &timeouts) != EXIT_SUCCESS) {
+            result = EC_TXN_IBF_STUCK;
+            break;
+        }
+        port_out(pb, reg, EC_DATA);
+
+        if (port_step(pb, EC_OP_READ, OBF, 1, &timeouts) != EXIT_SUCCESS) {
+            result = EC_TXN_OBF_TIMEOUT;
+            break;
+        }
+        *out = port_in(pb, EC_DATA);
+        if (port_plausible(pb, reg, *out))
+            break;
+
+        // The data byte is consumed, so an implausible value means asking again
+        if (attempt >= wait_config.step_retries) {
+            result = EC_TXN_IMPLAUSIBLE;
+            break;
+        }
+        ec_stats_record_retry(EC_OP_READ);
+        usleep(port_backoff_us(pb, attempt));
+    }
+    return port_finish(pb, EC_OP_READ, start, result, timeouts, attempt, reg);
+}
+
+static int port_read_batch(ec_backend_t* backend, const uint8_t* regs,
+        uint8_t* out, size_t n) {
+    ec_port_backend_t* pb = (ec_port_backend_t*) backend;
+    if (ec_lock_acquire() != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    int result = EXIT_SUCCESS;
+    for (size_t i = 0; i < n; i++) {
+        // After a failure the bus is cooling down, don't queue up behind it
+        if (port_read(pb, regs[i], &out[i]) != EXIT_SUCCESS) {
+            result = EXIT_FAILURE;
+            break;
+        }
+    }
+    ec_lock_release();
+    return result;
+}
+
+static int port_write(ec_backend_t* backend, uint8_t cmd, uint8_t port,
+        uint8_t value) {
+    ec_port_backend_t* pb = (ec_port_backend_t*) backend;
+    if (port_cooling_down(pb))
+        return EXIT_FAILURE;
+    if (ec_lock_acquire() != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    uint64_t start = ec_stats_now_ns();
+    unsigned int timeouts = 0;
+    ec_txn_result_t result = EC_TXN_IBF_STUCK;
+
+    if (port_step(pb, EC_OP_WRITE, IBF, 0, &timeouts) == EXIT_SUCCESS) {
+        port_out(pb, cmd, EC_SC);
+        if (port_step(pb, EC_OP_WRITE, IBF, 0, &timeouts) == EXIT_SUCCESS) {
+            port_out(pb, port, EC_DATA);
+            if (port_step(pb, EC_OP_WRITE, IBF, 0, &timeouts) == EXIT_SUCCESS) {
+                port_out(pb, value, EC_DATA);
+                if (port_step(pb, EC_OP_WRITE, IBF, 0, &timeouts) == EXIT_SUCCESS)
+                    result = EC_TXN_OK;
+            }
+        }
+    }
+    int status = port_finish(pb, EC_OP_WRITE, start, result, timeouts, 0, cmd);
+    ec_lock_release();
+    return status;
+}
+
+static int port_snapshot(ec_backend_t* backend, uint8_t* regs) {
+    uint8_t all[EC_REG_SIZE];
+    for (int i = 0; i < EC_REG_SIZE; i++)
+        all[i] = (uint8_t) i;
+    return port_read_batch(backend, all, regs, EC_REG_SIZE);
+}
+
+static ec_health_t port_health(ec_backend_t* backend) {
+    ec_port_backend_t* pb = (ec_port_backend_t*) backend;
+    if (pb->consecutive_failures >= EC_PORT_FAIL_LIMIT)
+        return EC_HEALTH_FAILED;
+    return pb->last_failed ? EC_HEALTH_DEGRADED : EC_HEALTH_OK;
+}
+
+static void port_close(ec_backend_t* backend) {
+    ec_port_backend_t* pb = (ec_port_backend_t*) backend;
+    if (pb->devport_fd >= 0) {
+        close(pb->devport_fd);
+    } else {
+        ioperm(EC_DATA, 1, 0);
+        ioperm(EC_SC, 1, 0);
+    }
+    free(pb);
+}
+
+static const ec_backend_ops_t port_ops = {
+        .read_batch = port_read_batch,
+        .write = port_write,
+        .snapshot = port_snapshot,
+        .health = port_health,
+        .close = port_close
+};
+
+ec_wait_config_t* ec_port_wait_config(void) {
+    return &wait_config;
+}
+
+ec_backend_t* ec_port_open(void) {
+    if (ioperm(EC_DATA, 1, 1) != 0)
+        return NULL;
+    if (ioperm(EC_SC, 1, 1) != 0)
+        return NULL;
+    ec_port_backend_t* pb = calloc(1, sizeof(*pb));
+    if (pb == NULL)
+        return NULL;
+    pb->base.ops = &port_ops;
+    pb->base.type = EC_BACKEND_PORT;
+    pb->devport_fd = -1;
+    pb->jitter = (uint32_t) ec_stats_now_ns() | 1;
+    port_calibrate_wait(pb);
+    return &pb->base;
+}
+
+ec_backend_t* ec_devport_open(void) {
+    int fd = open(EC_DEVPORT_PATH, O_RDWR | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+    ec_port_backend_t* pb = calloc(1, sizeof(*pb));
+    if (pb == NULL) {
+        close(fd);
+        return NULL;
+    }
+    pb->base.ops = &port_ops;
+    pb->base.type = EC_BACKEND_DEVPORT;
+    pb->devport_fd = fd;
+    pb->jitter = (uint32_t) ec_stats_now_ns() | 1;
+    port_calibrate_wait(pb);
+    return &pb->base;
+}
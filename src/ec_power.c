@@ -0,0 +1,107 @@
+#include "ec_power.h"
+#include "ec_stats.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <time.h>
+#include <unistd.h>
+
+static ec_power_config_t power_config = {
+        .enabled = 0,
+        .timer_slack_us = 20000
+};
+
+static int cached_battery = 0;
+static uint64_t cached_battery_ns = 0;
+
+ec_power_config_t* ec_power_config(void) {
+    return &power_config;
+}
+
+int ec_power_apply_slack(void) {
+    unsigned long slack_ns = (unsigned long) power_config.timer_slack_us * 1000UL;
+    if (prctl(PR_SET_TIMERSLACK, slack_ns, 0, 0, 0) != 0)
+        return EXIT_FAILURE;
+    ec_stats_get()->power.timer_slack_us = power_config.timer_slack_us;
+    return EXIT_SUCCESS;
+}
+
+// Read one attribute of a supply, newline stripped; -1 if it is missing
+static int power_read(const char* supply, const char* attribute, char* value, size_t size) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s/%s", EC_POWER_SUPPLY_PATH, supply, attribute);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    ssize_t n = read(fd, value, size - 1);
+    close(fd);
+    if (n < 0)
+        return -1;
+    value[n] = '\0';
+    value[strcspn(value, "\n")] = '\0';
+    return 0;
+}
+
+int ec_power_on_battery(void) {
+    DIR* dir = opendir(EC_POWER_SUPPLY_PATH);
+    if (dir == NULL)
+        return 0;
+    int battery = 0;
+    int external = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.')
+            continue;
+        char type[32];
+        char value[32];
+        if (power_read(entry->d_name, "type", type, sizeof(type)) != 0)
+            continue;
+        if (strcmp(type, "Battery") == 0) {
+            // Mice and headsets report their batteries here too
+            if (power_read(entry->d_name, "scope", value, sizeof(value)) == 0
+                    && strcmp(value, "Device") == 0)
+                continue;
+            battery = 1;
+        } else if (power_read(entry->d_name, "online", value, sizeof(value)) == 0
+                && strcmp(value, "1") == 0) {
+            external = 1;
+        }
+    }
+    closedir(dir);
+    return battery && !external;
+}
+
+int ec_power_battery(uint64_t now_ns) {
+    if (cached_battery_ns == 0 || now_ns - cached_battery_ns >= (uint64_t) EC_POWER_RECHECK_MS * 1000000ULL) {
+        cached_battery = ec_power_on_battery();
+        cached_battery_ns = now_ns;
+        ec_stats_get()->power.on_battery = (uint32_t) cached_battery;
+    }
+    return cached_battery;
+}
+
+unsigned int ec_power_period(unsigned int period_ms, int on_battery) {
+    unsigned int ticks = (period_ms + EC_POWER_TICK_MS - 1) / EC_POWER_TICK_MS;
+    if (ticks == 0)
+        ticks = 1;
+    if (on_battery)
+        ticks *= EC_POWER_BATTERY_STRETCH;
+    return ticks * EC_POWER_TICK_MS;
+}
+
+unsigned int ec_power_delay_ms(unsigned int period_ms) {
+    if (period_ms == 0)
+        return 0;
+    uint64_t now_ms = ec_stats_now_ns() / 1000000ULL;
+    return period_ms - (unsigned int) (now_ms % period_ms);
+}
+
+uint64_t ec_power_cpu_ns(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0)
+        return 0;
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
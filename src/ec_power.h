@@ -0,0 +1,51 @@
+#ifndef EC_POWER_H
+#define EC_POWER_H
+
+#include <stdint.h>
+
+// Where the kernel lists power supplies
+#ifndef EC_POWER_SUPPLY_PATH
+#define EC_POWER_SUPPLY_PATH "/sys/class/power_supply"
+#endif
+
+// Worker and UI periods are rounded to multiples of this tick and their
+// timers armed on multiples of it, so their wakeups land together
+#define EC_POWER_TICK_MS 100
+
+// Periods are multiplied by this while running on battery
+#define EC_POWER_BATTERY_STRETCH 2
+
+// How often the power source is read again
+#define EC_POWER_RECHECK_MS 30000
+
+// Power-aware scheduling, off by default
+typedef struct {
+    int enabled;
+    unsigned int timer_slack_us;  // how late the kernel may fire our timers (default 20000)
+} ec_power_config_t;
+
+// Tuning used by the functions below
+ec_power_config_t* ec_power_config(void);
+
+// Let the kernel batch our timers with others via PR_SET_TIMERSLACK;
+// inherited across fork. EXIT_SUCCESS or EXIT_FAILURE.
+int ec_power_apply_slack(void);
+
+// 1 if the machine runs on battery: a system battery is present and no
+// mains, USB or other external supply is online. Reads sysfs every call.
+int ec_power_on_battery(void);
+
+// ec_power_on_battery(), read again at most every EC_POWER_RECHECK_MS
+int ec_power_battery(uint64_t now_ns);
+
+// Period to use for `period_ms`: rounded up to a tick multiple and
+// stretched on battery
+unsigned int ec_power_period(unsigned int period_ms, int on_battery);
+
+// Milliseconds until the next multiple of `period_ms` on CLOCK_MONOTONIC
+unsigned int ec_power_delay_ms(unsigned int period_ms);
+
+// CPU time consumed by the calling process so far
+uint64_t ec_power_cpu_ns(void);
+
+#endif // EC_POWER_H
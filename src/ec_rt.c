@@ -0,0 +1,104 @@
+#define _GNU_SOURCE // sched_setaffinity, CPU_SET
+#include "ec_rt.h"
+#include "ec_loop.h"
+#include <alloca.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE 6
+#endif
+
+// Not in every libc's headers
+typedef struct {
+    uint32_t size;
+    uint32_t sched_policy;
+    uint64_t sched_flags;
+    int32_t sched_nice;
+    uint32_t sched_priority;
+    uint64_t sched_runtime;
+    uint64_t sched_deadline;
+    uint64_t sched_period;
+} rt_sched_attr_t;
+
+static ec_rt_config_t rt_config = {
+        .policy = EC_RT_NONE,
+        .priority = 10,
+        .cpu = -1,
+        .runtime_us = 5000,
+        .stack_kb = 64
+};
+
+static const char* rt_names[] = {
+        [EC_RT_NONE] = "none",
+        [EC_RT_FIFO] = "fifo",
+        [EC_RT_DEADLINE] = "deadline"
+};
+
+ec_rt_config_t* ec_rt_config(void) {
+    return &rt_config;
+}
+
+int ec_rt_parse(const char* name) {
+    for (int i = EC_RT_FIFO; i <= EC_RT_DEADLINE; i++) {
+        if (strcmp(name, rt_names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+const char* ec_rt_name(ec_rt_policy_t policy) {
+    return policy <= EC_RT_DEADLINE ? rt_names[policy] : "?";
+}
+
+// Touch the stack the loop will use so no page fault lands mid-tick
+static void __attribute__((noinline)) rt_prefault_stack(unsigned int kb) {
+    size_t size = (size_t) kb * 1024;
+    volatile unsigned char* stack = alloca(size);
+    for (size_t i = 0; i < size; i += 4096)
+        stack[i] = 0;
+}
+
+static int rt_set_deadline(void) {
+#ifdef SYS_sched_setattr
+    uint64_t period_ns = (uint64_t) EC_LOOP_MIN_PERIOD_MS * 1000000ULL;
+    rt_sched_attr_t attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.sched_policy = SCHED_DEADLINE;
+    attr.sched_runtime = (uint64_t) rt_config.runtime_us * 1000ULL;
+    attr.sched_deadline = period_ns;
+    attr.sched_period = period_ns;
+    return syscall(SYS_sched_setattr, 0, &attr, 0) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+#else
+    errno = ENOSYS;
+    return EXIT_FAILURE;
+#endif
+}
+
+int ec_rt_apply(void) {
+    if (rt_config.policy == EC_RT_NONE)
+        return EXIT_SUCCESS;
+    // The kernel refuses SCHED_DEADLINE for tasks with a restricted
+    // affinity, so pinning only goes with SCHED_FIFO
+    if (rt_config.cpu >= 0 && rt_config.policy == EC_RT_FIFO) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(rt_config.cpu, &cpus);
+        if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+            return EXIT_FAILURE;
+    }
+    rt_prefault_stack(rt_config.stack_kb);
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+        return EXIT_FAILURE;
+    if (rt_config.policy == EC_RT_DEADLINE)
+        return rt_set_deadline();
+    struct sched_param param = { .sched_priority = rt_config.priority };
+    return sched_setscheduler(0, SCHED_FIFO, &param) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,35 @@
+#ifndef EC_RT_H
+#define EC_RT_H
+
+// Opt-in real-time mode for the EC worker, so the control period holds
+// while the rest of the machine is saturated. Off by default.
+typedef enum {
+    EC_RT_NONE = 0,
+    EC_RT_FIFO,             // SCHED_FIFO at `priority`
+    EC_RT_DEADLINE          // SCHED_DEADLINE reserving runtime_us every EC_LOOP_MIN_PERIOD_MS
+} ec_rt_policy_t;
+
+typedef struct {
+    ec_rt_policy_t policy;
+    int priority;           // SCHED_FIFO priority, 1-99 (default 10)
+    int cpu;                // pin the worker to this CPU, -1 for any
+    unsigned int runtime_us; // SCHED_DEADLINE budget per period (default 5000)
+    unsigned int stack_kb;  // stack pre-faulted before locking memory (default 64)
+} ec_rt_config_t;
+
+// Tuning applied by ec_rt_apply()
+ec_rt_config_t* ec_rt_config(void);
+
+// Parse a policy name ("fifo", "deadline"), -1 if unknown
+int ec_rt_parse(const char* name);
+
+// Name of a policy for reports
+const char* ec_rt_name(ec_rt_policy_t policy);
+
+// Switch the calling thread to the configured policy: CPU affinity,
+// pre-faulted stack, mlockall and the scheduler. Nothing to do (and
+// EXIT_SUCCESS) for EC_RT_NONE; EXIT_FAILURE with errno set at the first
+// step the kernel refused.
+int ec_rt_apply(void);
+
+#endif // EC_RT_H
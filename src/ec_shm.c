@@ -0,0 +1,109 @@
+#include "ec_shm.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Set when the segment has a name to remove
+static int shm_named = 0;
+
+ec_shm_t* ec_shm_create(void) {
+    ec_shm_t* shm = MAP_FAILED;
+    // A crashed instance may have left its segment behind
+    shm_unlink(EC_SHM_NAME);
+    int fd = shm_open(EC_SHM_NAME, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+        // umask must not hide the segment from unprivileged readers
+        if (fchmod(fd, 0644) == 0 && ftruncate(fd, sizeof(ec_shm_t)) == 0)
+            shm = mmap(NULL, sizeof(ec_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (shm != MAP_FAILED)
+            shm_named = 1;
+        else
+            shm_unlink(EC_SHM_NAME);
+    } else if (errno == EEXIST) {
+        // Someone recreated the name between the unlink and the create
+        printf("Warning: %s was taken by another process, telemetry is not exported\n",
+                EC_SHM_NAME);
+    }
+    if (shm == MAP_FAILED)
+        shm = mmap(NULL, sizeof(ec_shm_t), PROT_READ | PROT_WRITE,
+                MAP_ANON | MAP_SHARED, -1, 0);
+    if (shm == MAP_FAILED)
+        return NULL;
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    ec_shm_header_t* header = &shm->header;
+    header->abi_version = EC_SHM_ABI_VERSION;
+    header->header_size = sizeof(ec_shm_header_t);
+    header->segment_size = sizeof(ec_shm_t);
+    header->telemetry_offset = offsetof(ec_shm_t, telemetry);
+    header->history_offset = offsetof(ec_shm_t, history);
+    header->history_size = EC_HISTORY_SIZE;
+    header->writer_pid = getpid();
+    header->live = 1;
+    header->started_realtime_ns = (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(header->magic, EC_SHM_MAGIC, sizeof(header->magic));
+    return shm;
+}
+
+void ec_shm_destroy(ec_shm_t* shm) {
+    if (shm == NULL)
+        return;
+    __atomic_store_n(&shm->header.live, 0, __ATOMIC_RELEASE);
+    if (shm_named)
+        shm_unlink(EC_SHM_NAME);
+    shm_named = 0;
+    munmap(shm, sizeof(*shm));
+}
+
+const ec_shm_t* ec_shm_attach(void) {
+    int fd = shm_open(EC_SHM_NAME, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(ec_shm_t)) {
+        close(fd);
+        errno = EPROTO;
+        return NULL;
+    }
+    // Any local user can create the name: only believe a segment that root
+    // or we wrote and nobody else can
+    if ((st.st_uid != 0 && st.st_uid != geteuid()) || (st.st_mode & 0022) != 0) {
+        close(fd);
+        errno = EACCES;
+        return NULL;
+    }
+    const ec_shm_t* shm = mmap(NULL, sizeof(ec_shm_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED)
+        return NULL;
+    const ec_shm_header_t* header = &shm->header;
+    if (memcmp(header->magic, EC_SHM_MAGIC, sizeof(header->magic)) != 0
+            || header->abi_version != EC_SHM_ABI_VERSION
+            || header->telemetry_offset != offsetof(ec_shm_t, telemetry)
+            || header->history_offset != offsetof(ec_shm_t, history)
+            || header->history_size != EC_HISTORY_SIZE) {
+        ec_shm_detach(shm);
+        errno = EPROTO;
+        return NULL;
+    }
+    if (!__atomic_load_n(&header->live, __ATOMIC_ACQUIRE)) {
+        ec_shm_detach(shm);
+        errno = ESRCH;
+        return NULL;
+    }
+    return shm;
+}
+
+void ec_shm_detach(const ec_shm_t* shm) {
+    if (shm != NULL)
+        munmap((void*) shm, sizeof(*shm));
+}
@@ -0,0 +1,63 @@
+#ifndef EC_SHM_H
+#define EC_SHM_H
+
+#include <stdint.h>
+#include "ec_telemetry.h"
+
+// Named telemetry segment for local monitoring agents.
+//
+// The running indicator publishes its live sample and sample history in the
+// POSIX shared-memory object EC_SHM_NAME (/dev/shm/clevo-indicator),
+// read-only to everyone but the writer. A reader maps it once with
+// ec_shm_attach() and then reads with ec_telemetry_read() and
+// ec_history_read() from ec_telemetry.h: no EC traffic and no system calls
+// per sample. Readers need only ec_shm.c and ec_telemetry.c.
+//
+// ABI rules: all integers are host-endian, offsets are from the start of
+// the segment, and fields are only ever appended. A reader must check magic
+// and abi_version, and must stop trusting the data once live drops to 0
+// (the writer exited; a new instance creates a fresh segment).
+
+#ifndef EC_SHM_NAME
+#define EC_SHM_NAME "/clevo-indicator"
+#endif
+#define EC_SHM_MAGIC "CLVTELEM"
+#define EC_SHM_ABI_VERSION 1
+
+typedef struct {
+    char magic[8];              // EC_SHM_MAGIC, written last
+    uint32_t abi_version;       // EC_SHM_ABI_VERSION
+    uint32_t header_size;       // sizeof(ec_shm_header_t)
+    uint32_t segment_size;      // sizeof(ec_shm_t)
+    uint32_t telemetry_offset;  // ec_seqlock_t, latest sample
+    uint32_t history_offset;    // ec_history_t, last history_size samples
+    uint32_t history_size;      // EC_HISTORY_SIZE
+    int32_t writer_pid;
+    volatile uint32_t live;     // 1 while the writer runs
+    uint64_t started_realtime_ns; // CLOCK_REALTIME when the segment was created
+} __attribute__((aligned(EC_CACHELINE))) ec_shm_header_t;
+
+typedef struct {
+    ec_shm_header_t header;
+    ec_seqlock_t telemetry;
+    ec_history_t history;
+} ec_shm_t;
+
+// Writer: create the named segment, replacing a stale one. Falls back to an
+// anonymous shared mapping (visible only to forked children) when POSIX
+// shared memory is unavailable, or with a warning when another process
+// grabs the name first. Returns NULL on failure.
+ec_shm_t* ec_shm_create(void);
+
+// Writer: mark the segment dead and remove its name
+void ec_shm_destroy(ec_shm_t* shm);
+
+// Reader: map the segment read-only and validate its header. Returns NULL
+// with errno set if there is no compatible live segment, or EACCES if it
+// is owned by someone other than root or the caller, or writable by others.
+const ec_shm_t* ec_shm_attach(void);
+
+// Reader: unmap a segment returned by ec_shm_attach()
+void ec_shm_detach(const ec_shm_t* shm);
+
+#endif // EC_SHM_H
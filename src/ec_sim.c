@@ -0,0 +1,203 @@
+#include "ec_sim.h"
+#include "ec_stats.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Integration step; the slowest time constant is tens of seconds
+#define SIM_STEP_NS 10000000ULL
+
+// Raw RPM register scale used by the Clevo EC (see calculate_fan_rpms)
+#define SIM_RPM_SCALE 2156220.0
+
+typedef struct {
+    ec_backend_t base;
+    ec_sim_config_t config;
+    uint8_t regs[EC_REG_SIZE];
+    uint64_t now_ns;            // simulated time
+    uint64_t wall_ns;           // wall clock at the last sync, 0 in manual mode
+    double cpu_c;
+    double gpu_c;
+    double rpm;
+    unsigned int transactions;
+} ec_sim_backend_t;
+
+static ec_sim_config_t sim_config = {
+        .time_scale = 1.0,
+        .ambient_c = 30.0,
+        .cpu_power_w = 35.0,
+        .gpu_power_w = 20.0,
+        .cpu_mass_j_per_c = 60.0,
+        .gpu_mass_j_per_c = 80.0,
+        .passive_w_per_c = 0.4,
+        .fan_w_per_c = 1.6,
+        .coupling_w_per_c = 0.3,
+        .max_rpm = 4400.0,
+        .rpm_tau_s = 1.5,
+        .ibf_ns = 5000,
+        .obf_ns = 15000,
+        .slow_every = 200,
+        .slow_ns = 2000000
+};
+
+ec_sim_config_t* ec_sim_config(void) {
+    return &sim_config;
+}
+
+static uint8_t sim_clamp_u8(double value) {
+    if (value < 0.0) return 0;
+    if (value > 255.0) return 255;
+    return (uint8_t) (value + 0.5);
+}
+
+static void sim_publish(ec_sim_backend_t* sb) {
+    sb->regs[EC_REG_CPU_TEMP] = sim_clamp_u8(sb->cpu_c);
+    sb->regs[EC_REG_GPU_TEMP] = sim_clamp_u8(sb->gpu_c);
+    int raw_rpm = sb->rpm >= 1.0 ? (int) (SIM_RPM_SCALE / sb->rpm) : 0;
+    if (raw_rpm > 0xFFFF) raw_rpm = 0xFFFF;
+    sb->regs[EC_REG_FAN_RPMS_HI] = (uint8_t) (raw_rpm >> 8);
+    sb->regs[EC_REG_FAN_RPMS_LO] = (uint8_t) (raw_rpm & 0xFF);
+}
+
+static void sim_integrate(ec_sim_backend_t* sb, double dt) {
+    const ec_sim_config_t* c = &sb->config;
+    double target_rpm = c->max_rpm * sb->regs[EC_REG_FAN_DUTY] / 255.0;
+    sb->rpm += (target_rpm - sb->rpm) * (c->rpm_tau_s > 0.0 ? dt / (c->rpm_tau_s + dt) : 1.0);
+
+    double fan = c->max_rpm > 0.0 ? sb->rpm / c->max_rpm : 0.0;
+    double to_ambient = c->passive_w_per_c + c->fan_w_per_c * fan;
+    double shared = c->coupling_w_per_c * (sb->cpu_c - sb->gpu_c);
+    sb->cpu_c += dt * (c->cpu_power_w - to_ambient * (sb->cpu_c - c->ambient_c) - shared)
+            / c->cpu_mass_j_per_c;
+    sb->gpu_c += dt * (c->gpu_power_w - to_ambient * (sb->gpu_c - c->ambient_c) + shared)
+            / c->gpu_mass_j_per_c;
+}
+
+static void sim_run(ec_sim_backend_t* sb, uint64_t ns) {
+    while (ns > 0) {
+        uint64_t step = ns < SIM_STEP_NS ? ns : SIM_STEP_NS;
+        sim_integrate(sb, (double) step / 1e9);
+        sb->now_ns += step;
+        ns -= step;
+    }
+    sim_publish(sb);
+}
+
+// Catch simulated time up with the scaled wall clock
+static void sim_sync(ec_sim_backend_t* sb) {
+    if (sb->config.time_scale <= 0.0)
+        return;
+    uint64_t wall = ec_stats_now_ns();
+    if (sb->wall_ns != 0 && wall > sb->wall_ns)
+        sim_run(sb, (uint64_t) ((double) (wall - sb->wall_ns) * sb->config.time_scale));
+    sb->wall_ns = wall;
+}
+
+// Handshake cost of one transaction moving `out` bytes to the EC and `in`
+// bytes back; in wall-clock mode the caller also pays it in real time
+static void sim_bus(ec_sim_backend_t* sb, ec_op_t op, int out, int in) {
+    uint64_t bus_ns = (uint64_t) out * sb->config.ibf_ns + (uint64_t) in * sb->config.obf_ns;
+    if (sb->config.slow_every > 0 && ++sb->transactions % sb->config.slow_every == 0)
+        bus_ns += sb->config.slow_ns;
+    ec_stats_record(op, bus_ns, out + in, 0);
+    ec_stats_record_txn(EC_TXN_OK);
+    if (sb->config.time_scale > 0.0) {
+        // Sleep rather than spin, so the simulator does not inflate the
+        // CPU time the benchmarks and power statistics measure
+        uint64_t until = ec_stats_now_ns() + (uint64_t) ((double) bus_ns / sb->config.time_scale);
+        struct timespec ts = { .tv_sec = (time_t) (until / 1000000000ULL),
+                .tv_nsec = (long) (until % 1000000000ULL) };
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+            ;
+    } else {
+        sim_run(sb, bus_ns);
+    }
+}
+
+static int sim_read_batch(ec_backend_t* backend, const uint8_t* regs,
+        uint8_t* out, size_t n) {
+    ec_sim_backend_t* sb = (ec_sim_backend_t*) backend;
+    sim_sync(sb);
+    for (size_t i = 0; i < n; i++) {
+        out[i] = sb->regs[regs[i]];
+        sim_bus(sb, EC_OP_READ, 2, 1);
+    }
+    return EXIT_SUCCESS;
+}
+
+static int sim_write(ec_backend_t* backend, uint8_t cmd, uint8_t port,
+        uint8_t value) {
+    ec_sim_backend_t* sb = (ec_sim_backend_t*) backend;
+    sim_sync(sb);
+    sim_bus(sb, EC_OP_WRITE, 3, 0);
+    if (cmd != EC_CMD_FAN_DUTY || port != EC_FAN_DUTY_PORT)
+        return EXIT_FAILURE;
+    sb->regs[EC_REG_FAN_DUTY] = value;
+    return EXIT_SUCCESS;
+}
+
+static int sim_snapshot(ec_backend_t* backend, uint8_t* regs) {
+    ec_sim_backend_t* sb = (ec_sim_backend_t*) backend;
+    sim_sync(sb);
+    memcpy(regs, sb->regs, EC_REG_SIZE);
+    return EXIT_SUCCESS;
+}
+
+static ec_health_t sim_health(ec_backend_t* backend) {
+    return EC_HEALTH_OK;
+}
+
+static void sim_close(ec_backend_t* backend) {
+    free(backend);
+}
+
+static const ec_backend_ops_t sim_ops = {
+        .read_batch = sim_read_batch,
+        .write = sim_write,
+        .snapshot = sim_snapshot,
+        .health = sim_health,
+        .close = sim_close
+};
+
+void ec_sim_advance(ec_backend_t* backend, uint64_t ns) {
+    if (backend == NULL || backend->ops != &sim_ops)
+        return;
+    sim_run((ec_sim_backend_t*) backend, ns);
+}
+
+void ec_sim_set_load(ec_backend_t* backend, double cpu_power_w, double gpu_power_w) {
+    if (backend == NULL || backend->ops != &sim_ops)
+        return;
+    ec_sim_backend_t* sb = (ec_sim_backend_t*) backend;
+    sim_sync(sb);
+    sb->config.cpu_power_w = cpu_power_w;
+    sb->config.gpu_power_w = gpu_power_w;
+}
+
+void ec_sim_state(ec_backend_t* backend, uint64_t* now_ns, double* cpu_c,
+        double* gpu_c, double* rpm) {
+    if (backend == NULL || backend->ops != &sim_ops)
+        return;
+    ec_sim_backend_t* sb = (ec_sim_backend_t*) backend;
+    if (now_ns != NULL) *now_ns = sb->now_ns;
+    if (cpu_c != NULL) *cpu_c = sb->cpu_c;
+    if (gpu_c != NULL) *gpu_c = sb->gpu_c;
+    if (rpm != NULL) *rpm = sb->rpm;
+}
+
+ec_backend_t* ec_sim_open(void) {
+    ec_sim_backend_t* sb = calloc(1, sizeof(*sb));
+    if (sb == NULL)
+        return NULL;
+    sb->base.ops = &sim_ops;
+    sb->base.type = EC_BACKEND_SIM;
+    sb->config = sim_config;
+    // Start idle at ambient with the fan at the EC's default 60%
+    sb->cpu_c = sb->config.ambient_c;
+    sb->gpu_c = sb->config.ambient_c;
+    sb->regs[EC_REG_FAN_DUTY] = 60 * 255 / 100;
+    sb->rpm = sb->config.max_rpm * sb->regs[EC_REG_FAN_DUTY] / 255.0;
+    sim_publish(sb);
+    return &sb->base;
+}
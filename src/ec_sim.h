@@ -0,0 +1,50 @@
+#ifndef EC_SIM_H
+#define EC_SIM_H
+
+#include "ec_backend.h"
+#include <stdint.h>
+
+// Simulated Clevo EC with a lumped thermal model, for benchmarking the
+// worker and the fan controller without hardware.
+//
+// CPU and GPU are each a thermal mass heated by a constant power and
+// cooled towards ambient through a passive path plus a fan path that
+// scales with the current RPM. The RPM follows the duty written through
+// the 0x99 command with a first-order lag, and every register transaction
+// costs simulated IBF/OBF handshake time.
+//
+// Simulated time either follows the wall clock multiplied by time_scale,
+// or, with time_scale 0, only moves on ec_sim_advance() so tests can run
+// an hour of thermals in milliseconds.
+typedef struct {
+    double time_scale;          // simulated seconds per wall second, 0 = manual
+    double ambient_c;
+    double cpu_power_w;         // heat input under the current load
+    double gpu_power_w;
+    double cpu_mass_j_per_c;    // thermal mass of die plus heatsink
+    double gpu_mass_j_per_c;
+    double passive_w_per_c;     // cooling with the fan stopped
+    double fan_w_per_c;         // additional cooling at max_rpm
+    double coupling_w_per_c;    // heat pipe shared by CPU and GPU
+    double max_rpm;             // RPM at 100% duty
+    double rpm_tau_s;           // fan spin-up/spin-down time constant
+    unsigned int ibf_ns;        // EC accepting one byte
+    unsigned int obf_ns;        // EC producing one byte
+    unsigned int slow_every;    // every nth transaction the EC is busy, 0 = never
+    unsigned int slow_ns;       // extra handshake time when busy
+} ec_sim_config_t;
+
+// Model parameters for simulators opened afterwards
+ec_sim_config_t* ec_sim_config(void);
+
+// Move simulated time forward, e.g. in manual mode
+void ec_sim_advance(ec_backend_t* backend, uint64_t ns);
+
+// Change the heat input, e.g. to model a load step
+void ec_sim_set_load(ec_backend_t* backend, double cpu_power_w, double gpu_power_w);
+
+// Current simulated time and model state; NULL-safe outputs
+void ec_sim_state(ec_backend_t* backend, uint64_t* now_ns, double* cpu_c,
+        double* gpu_c, double* rpm);
+
+#endif // EC_SIM_H
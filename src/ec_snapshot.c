@@ -0,0 +1,97 @@
+#include "ec_snapshot.h"
+#include "ec_stats.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Starting estimate for one register handshake before anything is measured
+#define SNAPSHOT_INITIAL_REG_NS 20000ULL
+
+static unsigned int budget_us = 0;
+static uint8_t buffers[2][EC_REG_SIZE];
+static int front = 0;            // index of the published buffer
+static uint32_t generation = 0;  // 0 until the first sweep completes
+static uint64_t completed_ns = 0;
+static int cursor = 0;           // next register of the back buffer
+static uint64_t sweep_started_ns = 0;
+static uint64_t reg_ns = SNAPSHOT_INITIAL_REG_NS;   // smoothed cost per register
+
+void ec_snapshot_set_budget_us(unsigned int us) {
+    budget_us = us;
+}
+
+unsigned int ec_snapshot_budget_us(void) {
+    return budget_us;
+}
+
+void ec_snapshot_reset(void) {
+    generation = 0;
+    completed_ns = 0;
+    cursor = 0;
+    sweep_started_ns = 0;
+    reg_ns = SNAPSHOT_INITIAL_REG_NS;
+}
+
+static int snapshot_publish(uint64_t now) {
+    front ^= 1;
+    generation++;
+    completed_ns = now;
+    cursor = 0;
+    ec_stats_t* stats = ec_stats_get();
+    stats->snapshots++;
+    ec_histogram_record(&stats->snapshot_sweep, now - sweep_started_ns);
+    sweep_started_ns = 0;
+    return 1;
+}
+
+// Only the in-memory backends read all 256 registers for free; behind
+// sysfs every register is still an EC transaction in the kernel
+static int snapshot_is_bulk(ec_backend_t* backend) {
+    return backend->type == EC_BACKEND_MOCK || backend->type == EC_BACKEND_SIM;
+}
+
+int ec_snapshot_step(ec_backend_t* backend) {
+    if (backend == NULL || budget_us == 0)
+        return 0;
+    uint8_t* back = buffers[front ^ 1];
+    uint64_t start = ec_stats_now_ns();
+    if (sweep_started_ns == 0)
+        sweep_started_ns = start;
+
+    if (snapshot_is_bulk(backend)) {
+        int result = ec_backend_snapshot(backend, back);
+        ec_histogram_record(&ec_stats_get()->snapshot_step, ec_stats_now_ns() - start);
+        if (result != EXIT_SUCCESS) {
+            sweep_started_ns = 0;
+            return -1;
+        }
+        return snapshot_publish(ec_stats_now_ns());
+    }
+
+    // Size the chunk so it fits the budget at the measured per-register cost
+    size_t remaining = EC_REG_SIZE - cursor;
+    size_t chunk = (size_t) ((uint64_t) budget_us * 1000ULL / reg_ns);
+    if (chunk < 1) chunk = 1;
+    if (chunk > remaining) chunk = remaining;
+
+    // Not ec_backend_read_batch(): chunks are timed in snapshot_step and
+    // must not skew its per-sample figures or the sysfs read plan
+    int result = ec_backend_read_range(backend, (uint8_t) cursor, back + cursor, chunk);
+    uint64_t now = ec_stats_now_ns();
+    ec_histogram_record(&ec_stats_get()->snapshot_step, now - start);
+    if (result != EXIT_SUCCESS) {
+        // A register we could not read would publish garbage: start over
+        cursor = 0;
+        sweep_started_ns = 0;
+        return -1;
+    }
+    reg_ns = (reg_ns * 7 + (now - start) / chunk) / 8;
+    if (reg_ns == 0) reg_ns = 1;
+    cursor += chunk;
+    return cursor == EC_REG_SIZE ? snapshot_publish(now) : 0;
+}
+
+const uint8_t* ec_snapshot_get(uint32_t* out_generation, uint64_t* out_completed_ns) {
+    if (out_generation != NULL) *out_generation = generation;
+    if (out_completed_ns != NULL) *out_completed_ns = completed_ns;
+    return generation > 0 ? buffers[front] : NULL;
+}
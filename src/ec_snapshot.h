@@ -0,0 +1,30 @@
+#ifndef EC_SNAPSHOT_H
+#define EC_SNAPSHOT_H
+
+#include "ec_backend.h"
+#include <stdint.h>
+
+// Full 0x00-0xFF register view for backends without a cheap bulk read.
+// Over port I/O a snapshot is 256 handshakes, so it is collected a chunk
+// per tick within a bus-time budget into a back buffer and published to
+// the front buffer once the sweep completes; sysfs is swept the same way,
+// a pread of a sub-range per tick. The in-memory backends (mock, sim) are
+// snapshotted in a single step.
+
+// Per-tick bus-time budget for port sweeps; 0 disables stepping
+void ec_snapshot_set_budget_us(unsigned int budget_us);
+unsigned int ec_snapshot_budget_us(void);
+
+// Advance the sweep by one tick. Returns 1 when a new snapshot was
+// published, 0 while the sweep is in progress and -1 on a read error,
+// which discards the partial sweep.
+int ec_snapshot_step(ec_backend_t* backend);
+
+// Latest complete snapshot, or NULL before the first one. Optionally
+// returns its generation and the CLOCK_MONOTONIC time it completed.
+const uint8_t* ec_snapshot_get(uint32_t* generation, uint64_t* completed_ns);
+
+// Forget published and partial snapshots, e.g. after switching backends
+void ec_snapshot_reset(void);
+
+#endif // EC_SNAPSHOT_H
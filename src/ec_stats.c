@@ -0,0 +1,308 @@
+#include "ec_stats.h"
+#include <string.h>
+#include <time.h>
+
+static ec_stats_t local_stats = {0};
+static ec_stats_t* current_stats = &local_stats;
+
+uint64_t ec_stats_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static int histogram_index(uint64_t ns) {
+    if (ns < EC_HIST_SUB_COUNT) {
+        return (int) ns;
+    }
+    int msb = 63 - __builtin_clzll(ns);
+    int shift = msb - EC_HIST_SUB_BITS;
+    int index = (shift + 1) * EC_HIST_SUB_COUNT
+            + (int) ((ns >> shift) & (EC_HIST_SUB_COUNT - 1));
+    return index < EC_HIST_BUCKETS ? index : EC_HIST_BUCKETS - 1;
+}
+
+static uint64_t histogram_upper_bound(int index) {
+    if (index < EC_HIST_SUB_COUNT) {
+        return (uint64_t) index;
+    }
+    int shift = index / EC_HIST_SUB_COUNT - 1;
+    int sub = index % EC_HIST_SUB_COUNT;
+    uint64_t lower = ((uint64_t) (EC_HIST_SUB_COUNT + sub)) << shift;
+    return lower + (1ULL << shift) - 1;
+}
+
+void ec_histogram_reset(ec_histogram_t* hist) {
+    memset(hist, 0, sizeof(*hist));
+}
+
+void ec_histogram_record(ec_histogram_t* hist, uint64_t ns) {
+    if (hist->count == 0 || ns < hist->min_ns) {
+        hist->min_ns = ns;
+    }
+    if (ns > hist->max_ns) {
+        hist->max_ns = ns;
+    }
+    hist->count++;
+    hist->total_ns += ns;
+    hist->buckets[histogram_index(ns)]++;
+}
+
+uint64_t ec_histogram_percentile(const ec_histogram_t* hist, double percentile) {
+    if (hist->count == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t) (percentile / 100.0 * (double) hist->count + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > hist->count) rank = hist->count;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < EC_HIST_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            uint64_t upper = histogram_upper_bound(i);
+            return upper < hist->max_ns ? upper : hist->max_ns;
+        }
+    }
+    return hist->max_ns;
+}
+
+void ec_histogram_print(FILE* out, const char* name, const ec_histogram_t* hist) {
+    if (hist->count == 0) {
+        fprintf(out, "  %-14s n=0\n", name);
+        return;
+    }
+    fprintf(out, "  %-14s n=%llu min=%.1f p50=%.1f p90=%.1f p99=%.1f max=%.1f avg=%.1f us\n",
+            name,
+            (unsigned long long) hist->count,
+            hist->min_ns / 1000.0,
+            ec_histogram_percentile(hist, 50.0) / 1000.0,
+            ec_histogram_percentile(hist, 90.0) / 1000.0,
+            ec_histogram_percentile(hist, 99.0) / 1000.0,
+            hist->max_ns / 1000.0,
+            (double) hist->total_ns / (double) hist->count / 1000.0);
+}
+
+void ec_wait_stats_print(FILE* out, const ec_wait_stats_t* stats) {
+    uint64_t waited_ns = stats->spin_latency.total_ns + stats->sleep_latency.total_ns;
+    fprintf(out, "EC wait: %llu waits, %llu spin, %llu sleep, %llu timeouts, %.1f%% of wait time asleep\n",
+            (unsigned long long) stats->waits,
+            (unsigned long long) stats->spin_hits,
+            (unsigned long long) stats->sleep_hits,
+            (unsigned long long) stats->timeouts,
+            waited_ns > 0 ? 100.0 * (double) stats->slept_ns / (double) waited_ns : 0.0);
+    ec_histogram_print(out, "spin phase", &stats->spin_latency);
+    ec_histogram_print(out, "sleep phase", &stats->sleep_latency);
+}
+
+void ec_stats_attach(ec_stats_t* storage) {
+    if (storage == NULL || storage == current_stats) return;
+    memcpy(storage, current_stats, sizeof(*storage));
+    current_stats = storage;
+}
+
+ec_stats_t* ec_stats_get(void) {
+    if (current_stats->started_ns == 0) {
+        current_stats->started_ns = ec_stats_now_ns();
+    }
+    return current_stats;
+}
+
+void ec_stats_record(ec_op_t op, uint64_t latency_ns, uint64_t bytes,
+        unsigned int timeouts) {
+    ec_op_stats_t* op_stats = &ec_stats_get()->ops[op];
+    op_stats->calls++;
+    op_stats->bytes += bytes;
+    op_stats->timeouts += timeouts;
+    op_stats->last_ns = latency_ns;
+    if (timeouts > 0) {
+        op_stats->errors++;
+    }
+    ec_histogram_record(&op_stats->latency, latency_ns);
+}
+
+void ec_stats_record_syscalls(ec_op_t op, unsigned int syscalls) {
+    ec_stats_get()->ops[op].syscalls += syscalls;
+}
+
+void ec_stats_record_retry(ec_op_t op) {
+    ec_stats_get()->ops[op].retries++;
+}
+
+void ec_stats_record_error(ec_op_t op) {
+    ec_stats_get()->ops[op].errors++;
+}
+
+const char* ec_op_name(ec_op_t op) {
+    switch (op) {
+        case EC_OP_READ: return "read";
+        case EC_OP_WRITE: return "write";
+        case EC_OP_SYSFS_READ: return "sysfs read";
+        case EC_OP_BATCH: return "read batch";
+        default: return "unknown";
+    }
+}
+
+const char* ec_phase_name(ec_phase_t phase) {
+    switch (phase) {
+        case EC_PHASE_READ: return "ec read";
+        case EC_PHASE_CONTROL: return "control";
+        case EC_PHASE_WRITE: return "ec write";
+        case EC_PHASE_PUBLISH: return "publish";
+        default: return "unknown";
+    }
+}
+
+void ec_stats_record_iteration(uint64_t due_ns, uint64_t done_ns,
+        const uint64_t phase_ns[EC_PHASE_COUNT]) {
+    ec_loop_stats_t* loop = &ec_stats_get()->loop;
+    uint64_t elapsed = done_ns > due_ns ? done_ns - due_ns : 0;
+    loop->iterations++;
+    ec_histogram_record(&loop->iteration, elapsed);
+    if (elapsed > (uint64_t) loop->slo_ms * 1000000ULL)
+        loop->deadline_misses++;
+    for (int phase = 0; phase < EC_PHASE_COUNT; phase++)
+        ec_histogram_record(&loop->phases[phase], phase_ns[phase]);
+}
+
+void ec_stats_record_txn(ec_txn_result_t result) {
+    ec_stats_get()->txn[result]++;
+}
+
+const char* ec_txn_result_name(ec_txn_result_t result) {
+    switch (result) {
+        case EC_TXN_OK: return "ok";
+        case EC_TXN_RECOVERED: return "recovered";
+        case EC_TXN_IBF_STUCK: return "ibf stuck";
+        case EC_TXN_OBF_TIMEOUT: return "obf timeout";
+        case EC_TXN_IMPLAUSIBLE: return "implausible";
+        case EC_TXN_COOLDOWN: return "cooldown";
+        default: return "unknown";
+    }
+}
+
+void ec_stats_print(FILE* out, const ec_stats_t* stats) {
+    fprintf(out, "EC transactions:\n");
+    for (int op = 0; op < EC_OP_COUNT; op++) {
+        const ec_op_stats_t* op_stats = &stats->ops[op];
+        if (op_stats->calls == 0 && op_stats->errors == 0) continue;
+        fprintf(out, "  %-14s calls=%llu errors=%llu timeouts=%llu retries=%llu bytes=%llu\n",
+                ec_op_name(op),
+                (unsigned long long) op_stats->calls,
+                (unsigned long long) op_stats->errors,
+                (unsigned long long) op_stats->timeouts,
+                (unsigned long long) op_stats->retries,
+                (unsigned long long) op_stats->bytes);
+        if (op_stats->syscalls > 0 && op_stats->calls > 0) {
+            fprintf(out, "  %-14s syscalls=%llu (%.2f per call)\n", "",
+                    (unsigned long long) op_stats->syscalls,
+                    (double) op_stats->syscalls / (double) op_stats->calls);
+        }
+        ec_histogram_print(out, "", &op_stats->latency);
+    }
+    uint64_t lookups = stats->cache_hits + stats->cache_misses;
+    if (lookups > 0) {
+        fprintf(out, "EC cache: %llu hits, %llu misses (%.1f%% served from cache)\n",
+                (unsigned long long) stats->cache_hits,
+                (unsigned long long) stats->cache_misses,
+                100.0 * (double) stats->cache_hits / (double) lookups);
+    }
+    if (stats->controller.updates > 0) {
+        double minutes = (double) (ec_stats_now_ns() - stats->started_ns) / 60e9;
+        fprintf(out, "Fan controller: %llu updates, %.2f writes/min, %llu excursions (%llu settled), overshoot last %d°C max %d°C\n",
+                (unsigned long long) stats->controller.updates,
+                minutes > 0 ? (double) stats->duty_writes_issued / minutes : 0.0,
+                (unsigned long long) stats->controller.excursions,
+                (unsigned long long) stats->controller.settled,
+                stats->controller.last_overshoot_c,
+                stats->controller.max_overshoot_c);
+        if (stats->controller.settled > 0)
+            ec_histogram_print(out, "settling", &stats->controller.settling);
+    }
+    if (stats->duty_writes_issued + stats->duty_writes_suppressed > 0) {
+        fprintf(out, "Fan duty writes: %llu issued, %llu suppressed, %llu confirmed, %llu mismatched\n",
+                (unsigned long long) stats->duty_writes_issued,
+                (unsigned long long) stats->duty_writes_suppressed,
+                (unsigned long long) stats->duty_writes_confirmed,
+                (unsigned long long) stats->duty_writes_mismatched);
+    }
+    if (stats->loop.wakeups > 0) {
+        uint64_t elapsed_ns = ec_stats_now_ns() - stats->started_ns;
+        fprintf(out, "Worker loop: period %u ms, %.2f wakeups/s (%llu timer, %llu missed ticks, %llu commands, %llu signals)\n",
+                stats->loop.period_ms,
+                elapsed_ns > 0 ? (double) stats->loop.wakeups * 1e9 / (double) elapsed_ns : 0.0,
+                (unsigned long long) stats->loop.timer_wakeups,
+                (unsigned long long) stats->loop.missed_ticks,
+                (unsigned long long) stats->loop.commands,
+                (unsigned long long) stats->loop.signals);
+        if (stats->loop.jitter.count > 0)
+            ec_histogram_print(out, "tick jitter", &stats->loop.jitter);
+        if (stats->loop.iterations > 0) {
+            fprintf(out, "Worker iterations: %llu, %llu over the %u ms SLO (%.2f%%)\n",
+                    (unsigned long long) stats->loop.iterations,
+                    (unsigned long long) stats->loop.deadline_misses,
+                    stats->loop.slo_ms,
+                    100.0 * (double) stats->loop.deadline_misses / (double) stats->loop.iterations);
+            ec_histogram_print(out, "due to done", &stats->loop.iteration);
+            for (int phase = 0; phase < EC_PHASE_COUNT; phase++)
+                ec_histogram_print(out, ec_phase_name(phase), &stats->loop.phases[phase]);
+        }
+    }
+    if (stats->power.worker_cpu_ns > 0 || stats->power.ui_wakeups > 0) {
+        // Per hour of running, the figure that matters on battery
+        double hours = (double) (ec_stats_now_ns() - stats->started_ns) / 3.6e12;
+        double seconds = hours * 3600.0;
+        fprintf(out, "Power: worker %.1f s CPU/h, UI %.2f wakeups/s, %.1f s CPU/h",
+                hours > 0 ? (double) stats->power.worker_cpu_ns / 1e9 / hours : 0.0,
+                seconds > 0 ? (double) stats->power.ui_wakeups / seconds : 0.0,
+                hours > 0 ? (double) stats->power.ui_cpu_ns / 1e9 / hours : 0.0);
+        if (stats->power.timer_slack_us > 0)
+            fprintf(out, " (power-aware, %s, timer slack %u ms)",
+                    stats->power.on_battery ? "on battery" : "on AC",
+                    stats->power.timer_slack_us / 1000);
+        fprintf(out, "\n");
+    }
+    if (stats->startup.first_sample_ns > 0) {
+        fprintf(out, "Startup: first sample %.1f ms, first duty write ", (double) stats->startup.first_sample_ns / 1e6);
+        if (stats->startup.first_write_ns > 0)
+            fprintf(out, "%.1f ms", (double) stats->startup.first_write_ns / 1e6);
+        else
+            fprintf(out, "none yet");
+        fprintf(out, " (ec_sys check %.1f ms)\n", (double) stats->startup.module_load_ns / 1e6);
+    }
+    if (stats->loop.teardown_ns > 0) {
+        fprintf(out, "Worker teardown: %.3f ms\n", (double) stats->loop.teardown_ns / 1e6);
+    }
+    if (stats->commands.applied > 0 || stats->commands.dropped > 0) {
+        fprintf(out, "UI commands: %llu applied, %llu dropped\n",
+                (unsigned long long) stats->commands.applied,
+                (unsigned long long) stats->commands.dropped);
+        ec_histogram_print(out, "click to EC", &stats->commands.latency);
+    }
+    uint64_t txns = 0;
+    for (int result = 0; result < EC_TXN_RESULT_COUNT; result++)
+        txns += stats->txn[result];
+    if (txns > 0) {
+        fprintf(out, "EC port outcomes:");
+        for (int result = 0; result < EC_TXN_RESULT_COUNT; result++)
+            fprintf(out, " %s=%llu", ec_txn_result_name(result),
+                    (unsigned long long) stats->txn[result]);
+        fprintf(out, "\n");
+    }
+    if (stats->snapshots > 0 || stats->snapshot_step.count > 0) {
+        fprintf(out, "EC snapshots: %llu published\n", (unsigned long long) stats->snapshots);
+        ec_histogram_print(out, "snapshot tick", &stats->snapshot_step);
+        if (stats->snapshots > 0)
+            ec_histogram_print(out, "snapshot sweep", &stats->snapshot_sweep);
+    }
+    if (stats->lock.acquisitions > 0) {
+        fprintf(out, "EC bus lock: %llu acquisitions, %llu contended, %llu timeouts, %llu refused\n",
+                (unsigned long long) stats->lock.acquisitions,
+                (unsigned long long) stats->lock.contended,
+                (unsigned long long) stats->lock.timeouts,
+                (unsigned long long) stats->lock.refused);
+        if (stats->lock.contended > 0)
+            ec_histogram_print(out, "lock wait", &stats->lock.wait);
+    }
+    ec_wait_stats_print(out, &stats->wait);
+}
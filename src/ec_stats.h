@@ -0,0 +1,216 @@
+#ifndef EC_STATS_H
+#define EC_STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Log-linear latency histogram: every power of two is split into
+// EC_HIST_SUB_COUNT linear sub-buckets, giving ~25% worst-case error
+// from nanoseconds up to ~18 minutes in a fixed 1.25 KiB footprint.
+#define EC_HIST_SUB_BITS 2
+#define EC_HIST_SUB_COUNT (1 << EC_HIST_SUB_BITS)
+#define EC_HIST_MAGNITUDES 40
+#define EC_HIST_BUCKETS (EC_HIST_MAGNITUDES * EC_HIST_SUB_COUNT)
+
+typedef struct {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t buckets[EC_HIST_BUCKETS];
+} ec_histogram_t;
+
+// Outcome of the adaptive status-register wait, split by the phase that
+// satisfied it so we can see how much of a poll is spent sleeping
+typedef struct {
+    uint64_t waits;
+    uint64_t spin_hits;
+    uint64_t sleep_hits;
+    uint64_t timeouts;
+    uint64_t slept_ns;
+    ec_histogram_t spin_latency;
+    ec_histogram_t sleep_latency;
+} ec_wait_stats_t;
+
+// Phases of one worker iteration
+typedef enum {
+    EC_PHASE_READ = 0,      // sample read, plus the snapshot chunk
+    EC_PHASE_CONTROL,       // fan controller and period adaptation
+    EC_PHASE_WRITE,         // fan duty writes, from commands or the controller
+    EC_PHASE_PUBLISH,       // telemetry, history, trace and daemon subscribers
+    EC_PHASE_COUNT
+} ec_phase_t;
+
+// Worker event loop (ec_loop.c)
+typedef struct {
+    uint64_t wakeups;
+    uint64_t timer_wakeups;
+    uint64_t missed_ticks;     // timer expirations beyond the first per wakeup
+    uint64_t commands;         // wake eventfd rung by another process
+    uint64_t signals;
+    unsigned int period_ms;    // current sample period
+    uint64_t teardown_ns;      // shutdown request to fan in safe state
+    ec_histogram_t jitter;     // timer wakeup lateness
+    uint64_t iterations;
+    uint64_t deadline_misses;  // iterations done more than slo_ms after their tick was due
+    uint32_t slo_ms;
+    ec_histogram_t iteration;  // tick due to iteration done
+    ec_histogram_t phases[EC_PHASE_COUNT];
+} ec_loop_stats_t;
+
+// Startup milestones, in ns after the stats started (at program start)
+typedef struct {
+    uint64_t module_load_ns;   // spent making sure ec_sys is loaded
+    uint64_t first_sample_ns;
+    uint64_t first_write_ns;   // first fan duty write that succeeded
+} ec_startup_stats_t;
+
+// Battery cost of the tool (ec_power.c)
+typedef struct {
+    uint64_t worker_cpu_ns;    // CPU time the worker has used so far
+    uint64_t ui_wakeups;       // indicator label refreshes
+    uint64_t ui_cpu_ns;        // CPU time the indicator process has used so far
+    uint32_t timer_slack_us;   // 0 unless power-aware scheduling is on
+    uint32_t on_battery;
+} ec_power_stats_t;
+
+// Fan controller behaviour (fan_pid.c)
+typedef struct {
+    uint64_t updates;
+    uint64_t excursions;       // times the temperature left the band around the target
+    uint64_t settled;          // excursions that came back and stayed
+    int32_t last_overshoot_c;  // peak above the target in the latest excursion
+    int32_t max_overshoot_c;
+    ec_histogram_t settling;   // excursion start to back in the band for good
+} ec_controller_stats_t;
+
+// UI commands handed to the worker (ec_command.c)
+typedef struct {
+    uint64_t applied;
+    uint64_t dropped;          // ring full
+    ec_histogram_t latency;    // click to EC write (or to applied, without a write)
+} ec_command_stats_t;
+
+// Outcome of one port-I/O transaction (ec_port.c)
+typedef enum {
+    EC_TXN_OK,
+    EC_TXN_RECOVERED,       // succeeded after retrying a step
+    EC_TXN_IBF_STUCK,       // EC never drained its input buffer
+    EC_TXN_OBF_TIMEOUT,     // EC never produced the data byte
+    EC_TXN_IMPLAUSIBLE,     // value failed the plausibility check
+    EC_TXN_COOLDOWN,        // rejected while the bus was cooling down
+    EC_TXN_RESULT_COUNT
+} ec_txn_result_t;
+
+// Cross-process EC bus lock (ec_lock.c)
+typedef struct {
+    uint64_t acquisitions;
+    uint64_t contended;
+    uint64_t timeouts;
+    uint64_t refused;        // no trustworthy lock file, transaction refused
+    ec_histogram_t wait;     // time spent waiting when contended
+} ec_lock_stats_t;
+
+// EC operations instrumented by every backend
+typedef enum {
+    EC_OP_READ = 0,     // one register read handshake over port I/O
+    EC_OP_WRITE,        // one command/port/value handshake over port I/O
+    EC_OP_SYSFS_READ,   // one read of /sys/kernel/debug/ec/ec0/io
+    EC_OP_BATCH,        // one ec_backend_read_batch, i.e. bus time per sample
+    EC_OP_COUNT
+} ec_op_t;
+
+typedef struct {
+    uint64_t calls;
+    uint64_t errors;
+    uint64_t timeouts;
+    uint64_t retries;
+    uint64_t bytes;
+    uint64_t syscalls;
+    uint64_t last_ns;
+    ec_histogram_t latency;
+} ec_op_stats_t;
+
+typedef struct {
+    uint64_t started_ns;
+    ec_op_stats_t ops[EC_OP_COUNT];
+    ec_wait_stats_t wait;
+    ec_lock_stats_t lock;
+    ec_loop_stats_t loop;
+    ec_command_stats_t commands;
+    ec_startup_stats_t startup;
+    ec_power_stats_t power;
+    ec_controller_stats_t controller;
+    uint64_t txn[EC_TXN_RESULT_COUNT];
+    uint64_t snapshots;                 // full-register snapshots published
+    ec_histogram_t snapshot_step;       // bus time per snapshot tick
+    ec_histogram_t snapshot_sweep;      // wall time from first chunk to publish
+    uint64_t cache_hits;
+    uint64_t cache_misses;
+    uint64_t duty_writes_issued;
+    uint64_t duty_writes_suppressed;
+    uint64_t duty_writes_confirmed;
+    uint64_t duty_writes_mismatched;
+} ec_stats_t;
+
+// CLOCK_MONOTONIC in nanoseconds, the time base for all EC statistics
+uint64_t ec_stats_now_ns(void);
+
+// Reset a histogram to empty
+void ec_histogram_reset(ec_histogram_t* hist);
+
+// Record one latency sample in nanoseconds
+void ec_histogram_record(ec_histogram_t* hist, uint64_t ns);
+
+// Upper bound of the bucket holding the given percentile (0-100)
+uint64_t ec_histogram_percentile(const ec_histogram_t* hist, double percentile);
+
+// Print a one-line summary (count, min, p50, p90, p99, max) in microseconds
+void ec_histogram_print(FILE* out, const char* name, const ec_histogram_t* hist);
+
+// Print the adaptive wait report
+void ec_wait_stats_print(FILE* out, const ec_wait_stats_t* stats);
+
+// Move recording into caller-provided storage (e.g. the shared page),
+// carrying over everything recorded so far
+void ec_stats_attach(ec_stats_t* storage);
+
+// Current statistics storage
+ec_stats_t* ec_stats_get(void);
+
+// Record one completed operation, its bus traffic and how many of its
+// status waits timed out
+void ec_stats_record(ec_op_t op, uint64_t latency_ns, uint64_t bytes,
+        unsigned int timeouts);
+
+// Record the system calls an operation needed
+void ec_stats_record_syscalls(ec_op_t op, unsigned int syscalls);
+
+// Record a retried step of an operation
+void ec_stats_record_retry(ec_op_t op);
+
+// Record an operation that failed outright
+void ec_stats_record_error(ec_op_t op);
+
+// Human-readable operation name
+const char* ec_op_name(ec_op_t op);
+
+// Human-readable iteration phase
+const char* ec_phase_name(ec_phase_t phase);
+
+// Record one worker iteration: the time its tick was due, when it was
+// done and the time spent in each phase. Over loop.slo_ms counts as a
+// deadline miss.
+void ec_stats_record_iteration(uint64_t due_ns, uint64_t done_ns,
+        const uint64_t phase_ns[EC_PHASE_COUNT]);
+
+// Count a port-I/O transaction outcome
+void ec_stats_record_txn(ec_txn_result_t result);
+
+// Human-readable transaction outcome
+const char* ec_txn_result_name(ec_txn_result_t result);
+
+// Print per-operation counters, latency histograms and the wait report
+void ec_stats_print(FILE* out, const ec_stats_t* stats);
+
+#endif // EC_STATS_H
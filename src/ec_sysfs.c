@@ -0,0 +1,292 @@
+#include "ec_backend.h"
+#include "ec_stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef MODULE_INIT_COMPRESSED_FILE
+#define MODULE_INIT_COMPRESSED_FILE 4
+#endif
+
+// Reading a few unused bytes is cheaper than another pread
+#define SYSFS_MERGE_GAP 8
+
+typedef struct {
+    uint16_t start;
+    uint16_t len;
+} sysfs_range_t;
+
+// Reads come from one long-lived fd on the ec_sys debugfs file, using pread
+// at the offsets in the read plan; fan duty commands are not plain register
+// writes, so writes go through a port I/O backend opened on demand.
+typedef struct {
+    ec_backend_t base;
+    ec_backend_t* writer;
+    int fd;
+    uint8_t plan[EC_REG_SIZE];          // 1 if the register is read each sample
+    sysfs_range_t ranges[EC_REG_SIZE];
+    int range_count;
+    uint8_t regs[EC_REG_SIZE];          // values from the last read
+    int failed;
+    int degraded;
+} ec_sysfs_backend_t;
+
+// Registers every plan starts with, plus anything added by
+// ec_sysfs_add_plan_registers before the backend is opened
+static uint8_t configured_plan[EC_REG_SIZE] = {
+        [EC_REG_CPU_TEMP] = 1,
+        [EC_REG_GPU_TEMP] = 1,
+        [EC_REG_FAN_DUTY] = 1,
+        [EC_REG_FAN_RPMS_HI] = 1,
+        [EC_REG_FAN_RPMS_LO] = 1
+};
+
+static void sysfs_build_plan(ec_sysfs_backend_t* sb) {
+    sb->range_count = 0;
+    int reg = 0;
+    while (reg < EC_REG_SIZE) {
+        if (!sb->plan[reg]) {
+            reg++;
+            continue;
+        }
+        int start = reg;
+        int end = reg; // last planned register in this range
+        for (reg = reg + 1; reg < EC_REG_SIZE && reg <= end + SYSFS_MERGE_GAP; reg++) {
+            if (sb->plan[reg])
+                end = reg;
+        }
+        sb->ranges[sb->range_count].start = start;
+        sb->ranges[sb->range_count].len = end - start + 1;
+        sb->range_count++;
+        reg = end + 1;
+    }
+}
+
+static int sysfs_reopen(ec_sysfs_backend_t* sb, unsigned int* syscalls) {
+    if (sb->fd >= 0) {
+        close(sb->fd);
+        (*syscalls)++;
+    }
+    sb->fd = open(EC_SYSFS_PATH, O_RDONLY | O_CLOEXEC, 0);
+    (*syscalls)++;
+    return sb->fd >= 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// pread the whole range, reopening the file once if the read fails (e.g.
+// ec_sys was reloaded underneath us)
+static int sysfs_pread(ec_sysfs_backend_t* sb, uint16_t start, uint16_t len,
+        unsigned int* syscalls) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (attempt > 0) {
+            ec_stats_record_retry(EC_OP_SYSFS_READ);
+            if (sysfs_reopen(sb, syscalls) != EXIT_SUCCESS)
+                return EXIT_FAILURE;
+        }
+        ssize_t len_read;
+        do {
+            len_read = pread(sb->fd, sb->regs + start, len, start);
+            (*syscalls)++;
+        } while (len_read < 0 && errno == EINTR);
+        if (len_read == len)
+            return EXIT_SUCCESS;
+    }
+    return EXIT_FAILURE;
+}
+
+static int sysfs_read_ranges(ec_sysfs_backend_t* sb, const sysfs_range_t* ranges,
+        int count) {
+    uint64_t start = ec_stats_now_ns();
+    unsigned int syscalls = 0;
+    uint64_t bytes = 0;
+    for (int i = 0; i < count; i++) {
+        if (sysfs_pread(sb, ranges[i].start, ranges[i].len, &syscalls) != EXIT_SUCCESS) {
+            ec_stats_record_error(EC_OP_SYSFS_READ);
+            ec_stats_record_syscalls(EC_OP_SYSFS_READ, syscalls);
+            sb->failed = 1;
+            return EXIT_FAILURE;
+        }
+        bytes += ranges[i].len;
+    }
+    ec_stats_record(EC_OP_SYSFS_READ, ec_stats_now_ns() - start, bytes, 0);
+    ec_stats_record_syscalls(EC_OP_SYSFS_READ, syscalls);
+    sb->failed = 0;
+    return EXIT_SUCCESS;
+}
+
+static int sysfs_snapshot(ec_backend_t* backend, uint8_t* regs) {
+    ec_sysfs_backend_t* sb = (ec_sysfs_backend_t*) backend;
+    const sysfs_range_t all = { 0, EC_REG_SIZE };
+    if (sysfs_read_ranges(sb, &all, 1) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    memcpy(regs, sb->regs, EC_REG_SIZE);
+    return EXIT_SUCCESS;
+}
+
+// One pread of the range, without adding it to the sample's plan
+static int sysfs_read_range(ec_backend_t* backend, uint8_t first, uint8_t* out,
+        size_t n) {
+    ec_sysfs_backend_t* sb = (ec_sysfs_backend_t*) backend;
+    const sysfs_range_t range = { first, (uint16_t) n };
+    if (sysfs_read_ranges(sb, &range, 1) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    memcpy(out, sb->regs + first, n);
+    return EXIT_SUCCESS;
+}
+
+static int sysfs_read_batch(ec_backend_t* backend, const uint8_t* regs,
+        uint8_t* out, size_t n) {
+    ec_sysfs_backend_t* sb = (ec_sysfs_backend_t*) backend;
+    int plan_changed = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!sb->plan[regs[i]]) {
+            sb->plan[regs[i]] = 1;
+            plan_changed = 1;
+        }
+    }
+    if (plan_changed)
+        sysfs_build_plan(sb);
+
+    // Only the planned ranges holding a requested register, so a caller
+    // serving part of the sample from cache also saves the syscalls
+    sysfs_range_t needed[EC_REG_SIZE];
+    int needed_count = 0;
+    for (int r = 0; r < sb->range_count; r++) {
+        for (size_t i = 0; i < n; i++) {
+            if (regs[i] >= sb->ranges[r].start
+                    && regs[i] < sb->ranges[r].start + sb->ranges[r].len) {
+                needed[needed_count++] = sb->ranges[r];
+                break;
+            }
+        }
+    }
+    if (sysfs_read_ranges(sb, needed, needed_count) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    for (size_t i = 0; i < n; i++)
+        out[i] = sb->regs[regs[i]];
+    return EXIT_SUCCESS;
+}
+
+static int sysfs_write(ec_backend_t* backend, uint8_t cmd, uint8_t port,
+        uint8_t value) {
+    ec_sysfs_backend_t* sb = (ec_sysfs_backend_t*) backend;
+    if (sb->writer == NULL) {
+        sb->writer = ec_port_open();
+        if (sb->writer == NULL)
+            sb->writer = ec_devport_open();
+        if (sb->writer == NULL) {
+            ec_stats_record_error(EC_OP_WRITE);
+            return EXIT_FAILURE;
+        }
+    }
+    int result = ec_backend_write(sb->writer, cmd, port, value);
+    sb->degraded = result != EXIT_SUCCESS;
+    return result;
+}
+
+static ec_health_t sysfs_health(ec_backend_t* backend) {
+    ec_sysfs_backend_t* sb = (ec_sysfs_backend_t*) backend;
+    if (sb->failed)
+        return EC_HEALTH_FAILED;
+    return sb->degraded ? EC_HEALTH_DEGRADED : EC_HEALTH_OK;
+}
+
+static void sysfs_close(ec_backend_t* backend) {
+    ec_sysfs_backend_t* sb = (ec_sysfs_backend_t*) backend;
+    if (sb->writer != NULL)
+        ec_backend_close(sb->writer);
+    if (sb->fd >= 0)
+        close(sb->fd);
+    free(sb);
+}
+
+static const ec_backend_ops_t sysfs_ops = {
+        .read_batch = sysfs_read_batch,
+        .write = sysfs_write,
+        .snapshot = sysfs_snapshot,
+        .read_range = sysfs_read_range,
+        .health = sysfs_health,
+        .close = sysfs_close
+};
+
+void ec_sysfs_add_plan_registers(const uint8_t* regs, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        configured_plan[regs[i]] = 1;
+}
+
+ec_backend_t* ec_sysfs_open(void) {
+    int fd = open(EC_SYSFS_PATH, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0)
+        return NULL;
+    ec_sysfs_backend_t* sb = calloc(1, sizeof(*sb));
+    if (sb == NULL) {
+        close(fd);
+        return NULL;
+    }
+    sb->base.ops = &sysfs_ops;
+    sb->base.type = EC_BACKEND_SYSFS;
+    sb->fd = fd;
+    memcpy(sb->plan, configured_plan, sizeof(sb->plan));
+    sysfs_build_plan(sb);
+    return &sb->base;
+}
+
+// Load ec_sys from the running kernel's module tree. ec_sys has no
+// dependencies, so this is all modprobe would do; kernels that cannot
+// decompress modules themselves reject the compressed file and we fall back.
+static int sysfs_finit_module(void) {
+#ifdef SYS_finit_module
+    static const char* suffixes[] = { "", ".zst", ".xz", ".gz" };
+    struct utsname uts;
+    if (uname(&uts) != 0)
+        return EXIT_FAILURE;
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+        char path[512];
+        snprintf(path, sizeof(path), "/lib/modules/%s/kernel/drivers/acpi/ec_sys.ko%s",
+                uts.release, suffixes[i]);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            continue;
+        int flags = suffixes[i][0] != '\0' ? MODULE_INIT_COMPRESSED_FILE : 0;
+        long result = syscall(SYS_finit_module, fd, "", flags);
+        close(fd);
+        if (result == 0 || errno == EEXIST)
+            return EXIT_SUCCESS;
+        return EXIT_FAILURE;
+    }
+#endif
+    return EXIT_FAILURE;
+}
+
+static int sysfs_spawn_modprobe(void) {
+    static const char* modprobe_paths[] = { "/sbin/modprobe", "/usr/sbin/modprobe" };
+    char* argv[] = { "modprobe", "-q", "ec_sys", NULL };
+    // Never hand the desktop user's environment (MODPROBE_OPTIONS...) to root
+    char* envp[] = { "PATH=/usr/sbin:/usr/bin:/sbin:/bin", NULL };
+    for (size_t i = 0; i < sizeof(modprobe_paths) / sizeof(modprobe_paths[0]); i++) {
+        if (access(modprobe_paths[i], X_OK) != 0)
+            continue;
+        pid_t pid;
+        if (posix_spawn(&pid, modprobe_paths[i], NULL, NULL, argv, envp) != 0)
+            return EXIT_FAILURE;
+        int status = 0;
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+            ;
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    return EXIT_FAILURE;
+}
+
+int ec_sysfs_load_module(void) {
+    if (access(EC_SYS_MODULE_PATH, F_OK) == 0)
+        return EXIT_SUCCESS;
+    if (sysfs_finit_module() != EXIT_SUCCESS)
+        sysfs_spawn_modprobe();
+    return access(EC_SYS_MODULE_PATH, F_OK) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
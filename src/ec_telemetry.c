@@ -0,0 +1,100 @@
+#include "ec_telemetry.h"
+#include <stdlib.h>
+#include <string.h>
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __asm__ __volatile__("pause" ::: "memory");
+#endif
+}
+
+void ec_telemetry_publish(ec_seqlock_t* lock, const ec_telemetry_t* sample) {
+    uint32_t seq = __atomic_load_n(&lock->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&lock->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy((void*) &lock->sample, sample, sizeof(*sample));
+    __atomic_store_n(&lock->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+unsigned int ec_telemetry_read(const ec_seqlock_t* lock, ec_telemetry_t* sample) {
+    unsigned int retries = 0;
+    for (;;) {
+        uint32_t before = __atomic_load_n(&lock->seq, __ATOMIC_ACQUIRE);
+        if ((before & 1) == 0) {
+            memcpy(sample, (const void*) &lock->sample, sizeof(*sample));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&lock->seq, __ATOMIC_RELAXED) == before)
+                return retries;
+        }
+        retries++;
+        cpu_relax();
+    }
+}
+
+void ec_history_append(ec_history_t* history, const ec_telemetry_t* sample) {
+    ec_history_slot_t* slot = &history->slots[sample->sequence % EC_HISTORY_SIZE];
+    __atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy((void*) &slot->sample, sample, sizeof(*sample));
+    __atomic_store_n(&slot->seq, sample->sequence, __ATOMIC_RELEASE);
+    __atomic_store_n(&history->head, sample->sequence, __ATOMIC_RELEASE);
+}
+
+uint64_t ec_history_head(const ec_history_t* history) {
+    return __atomic_load_n(&history->head, __ATOMIC_ACQUIRE);
+}
+
+size_t ec_history_read(const ec_history_t* history, uint64_t* cursor,
+        ec_telemetry_t* samples, size_t max, uint64_t* lost) {
+    uint64_t head = ec_history_head(history);
+    uint64_t next = *cursor + 1;
+    uint64_t skipped = 0;
+    // anything more than a lap behind is gone already
+    if (head >= EC_HISTORY_SIZE && next < head - EC_HISTORY_SIZE + 1) {
+        skipped = head - EC_HISTORY_SIZE + 1 - next;
+        next = head - EC_HISTORY_SIZE + 1;
+    }
+    size_t count = 0;
+    while (next <= head && count < max) {
+        const ec_history_slot_t* slot = &history->slots[next % EC_HISTORY_SIZE];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) == next) {
+            memcpy(&samples[count], (const void*) &slot->sample, sizeof(samples[count]));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == next)
+                count++;
+            else
+                skipped++;
+        } else {
+            // the writer lapped us on this slot while we were reading
+            skipped++;
+        }
+        next++;
+    }
+    *cursor = next - 1;
+    if (lost != NULL)
+        *lost = skipped;
+    return count;
+}
+
+int ec_history_temp_rate(const ec_history_t* history, uint64_t window_ns, double* rate,
+        uint64_t* span_ns) {
+    static ec_telemetry_t samples[EC_HISTORY_SIZE];
+    uint64_t head = ec_history_head(history);
+    uint64_t cursor = head > EC_HISTORY_SIZE ? head - EC_HISTORY_SIZE : 0;
+    size_t count = ec_history_read(history, &cursor, samples, EC_HISTORY_SIZE, NULL);
+    if (count < 2)
+        return EXIT_FAILURE;
+    const ec_telemetry_t* newest = &samples[count - 1];
+    size_t first = 0;
+    while (first < count - 2 && newest->sampled_ns - samples[first].sampled_ns > window_ns)
+        first++;
+    const ec_telemetry_t* oldest = &samples[first];
+    if (newest->sampled_ns <= oldest->sampled_ns)
+        return EXIT_FAILURE;
+    int newest_temp = newest->cpu_temp > newest->gpu_temp ? newest->cpu_temp : newest->gpu_temp;
+    int oldest_temp = oldest->cpu_temp > oldest->gpu_temp ? oldest->cpu_temp : oldest->gpu_temp;
+    *rate = (newest_temp - oldest_temp) * 60e9 / (double) (newest->sampled_ns - oldest->sampled_ns);
+    if (span_ns != NULL)
+        *span_ns = newest->sampled_ns - oldest->sampled_ns;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,71 @@
+#ifndef EC_TELEMETRY_H
+#define EC_TELEMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define EC_CACHELINE 64
+#define EC_HISTORY_SIZE 256         // samples kept, a power of two
+
+// One consistent worker sample
+typedef struct {
+    uint64_t sequence;          // sample number, 0 before the first sample
+    uint64_t sampled_ns;        // CLOCK_MONOTONIC when the EC was read
+    int32_t cpu_temp;           // °C
+    int32_t gpu_temp;           // °C
+    int32_t fan_duty;           // percent, as read back from the EC
+    int32_t fan_rpms;
+    int32_t commanded_duty;     // percent last written by the worker, 0 if none
+    int32_t loop_latency_us;    // worker wake-up to published sample
+} ec_telemetry_t;
+
+// Latest sample behind a sequence lock. The worker is the only writer and
+// owns the whole cache line, so readers never share a line with anything
+// the writer touches between samples and never see a half-written sample.
+typedef struct {
+    volatile uint32_t seq;      // odd while a write is in progress
+    uint32_t reserved;
+    ec_telemetry_t sample;
+} __attribute__((aligned(EC_CACHELINE))) ec_seqlock_t;
+
+// History slot; seq is the sample number it holds, 0 while being rewritten
+typedef struct {
+    volatile uint64_t seq;
+    ec_telemetry_t sample;
+} ec_history_slot_t;
+
+// Ring of the last EC_HISTORY_SIZE samples. The worker appends without ever
+// waiting on readers; a reader keeps its own cursor (the last sequence it
+// consumed) and learns how many samples it lost when it falls a lap behind.
+typedef struct {
+    volatile uint64_t head __attribute__((aligned(EC_CACHELINE))); // newest sequence
+    ec_history_slot_t slots[EC_HISTORY_SIZE] __attribute__((aligned(EC_CACHELINE)));
+} ec_history_t;
+
+// Publish a sample; single writer only
+void ec_telemetry_publish(ec_seqlock_t* lock, const ec_telemetry_t* sample);
+
+// Copy the latest sample, retrying while a write is in flight. Returns the
+// number of retries.
+unsigned int ec_telemetry_read(const ec_seqlock_t* lock, ec_telemetry_t* sample);
+
+// Append a sample numbered sample->sequence (1, 2, ...); single writer only
+void ec_history_append(ec_history_t* history, const ec_telemetry_t* sample);
+
+// Sequence of the newest appended sample, 0 while empty
+uint64_t ec_history_head(const ec_history_t* history);
+
+// Copy up to max samples newer than *cursor, oldest first, and advance the
+// cursor. Samples overwritten before they could be copied are skipped and
+// counted in *lost (may be NULL). Returns the number of samples copied.
+size_t ec_history_read(const ec_history_t* history, uint64_t* cursor,
+        ec_telemetry_t* samples, size_t max, uint64_t* lost);
+
+// Rate of change of the hotter of CPU/GPU in °C per minute over the last
+// window_ns, or over what the ring holds if that is less. The time the
+// rate was actually taken over is stored in *span_ns (may be NULL).
+// Returns EXIT_FAILURE if the history does not span two samples.
+int ec_history_temp_rate(const ec_history_t* history, uint64_t window_ns, double* rate,
+        uint64_t* span_ns);
+
+#endif // EC_TELEMETRY_H
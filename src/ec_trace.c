@@ -0,0 +1,147 @@
+#include "ec_trace.h"
+#include "ec_stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/fsuid.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// About five seconds of samples per write(2)
+#define TRACE_BUFFER_RECORDS 32
+
+struct ec_trace_writer {
+    int fd;
+    uint64_t started_ns;
+    size_t buffered;
+    ec_trace_record_t buffer[TRACE_BUFFER_RECORDS];
+};
+
+static int trace_write_all(int fd, const void* data, size_t size) {
+    const char* p = data;
+    while (size > 0) {
+        ssize_t written = write(fd, p, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return EXIT_FAILURE;
+        }
+        p += written;
+        size -= (size_t) written;
+    }
+    return EXIT_SUCCESS;
+}
+
+// Trace paths come from the command line: open them with the invoking
+// user's filesystem credentials, so a setuid-root install cannot be used
+// to create, truncate or read files the user has no access to, and never
+// through a symlink
+static int trace_open(const char* path, int flags, mode_t mode) {
+    gid_t fsgid = (gid_t) setfsgid(getgid());
+    uid_t fsuid = (uid_t) setfsuid(getuid());
+    int fd = open(path, flags | O_NOFOLLOW | O_CLOEXEC, mode);
+    int saved_errno = errno;
+    setfsuid(fsuid);
+    setfsgid(fsgid);
+    errno = saved_errno;
+    return fd;
+}
+
+ec_trace_writer_t* ec_trace_create(const char* path) {
+    int fd = trace_open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return NULL;
+    ec_trace_writer_t* writer = calloc(1, sizeof(*writer));
+    if (writer == NULL) {
+        close(fd);
+        return NULL;
+    }
+    writer->fd = fd;
+    writer->started_ns = ec_stats_now_ns();
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ec_trace_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, EC_TRACE_MAGIC, sizeof(header.magic));
+    header.version = EC_TRACE_VERSION;
+    header.header_size = sizeof(ec_trace_header_t);
+    header.record_size = sizeof(ec_trace_record_t);
+    header.started_realtime_ns = (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+    header.started_monotonic_ns = writer->started_ns;
+    if (trace_write_all(fd, &header, sizeof(header)) != EXIT_SUCCESS) {
+        close(fd);
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+int ec_trace_append(ec_trace_writer_t* writer, ec_trace_record_t* record) {
+    if (writer == NULL)
+        return EXIT_FAILURE;
+    record->t_ns = ec_stats_now_ns() - writer->started_ns;
+    writer->buffer[writer->buffered++] = *record;
+    if (writer->buffered == TRACE_BUFFER_RECORDS)
+        return ec_trace_flush(writer);
+    return EXIT_SUCCESS;
+}
+
+int ec_trace_flush(ec_trace_writer_t* writer) {
+    if (writer == NULL || writer->buffered == 0)
+        return EXIT_SUCCESS;
+    int result = trace_write_all(writer->fd, writer->buffer,
+            writer->buffered * sizeof(ec_trace_record_t));
+    writer->buffered = 0;
+    return result;
+}
+
+void ec_trace_close(ec_trace_writer_t* writer) {
+    if (writer == NULL)
+        return;
+    ec_trace_flush(writer);
+    close(writer->fd);
+    free(writer);
+}
+
+int ec_trace_map(const char* path, ec_trace_t* trace) {
+    memset(trace, 0, sizeof(*trace));
+    int fd = trace_open(path, O_RDONLY, 0);
+    if (fd < 0)
+        return EXIT_FAILURE;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(ec_trace_header_t)) {
+        close(fd);
+        errno = EINVAL;
+        return EXIT_FAILURE;
+    }
+    void* map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return EXIT_FAILURE;
+
+    const ec_trace_header_t* header = map;
+    if (memcmp(header->magic, EC_TRACE_MAGIC, sizeof(header->magic)) != 0
+            || header->version != EC_TRACE_VERSION
+            || header->header_size != sizeof(ec_trace_header_t)
+            || header->record_size != sizeof(ec_trace_record_t)) {
+        munmap(map, (size_t) st.st_size);
+        errno = EINVAL;
+        return EXIT_FAILURE;
+    }
+    trace->header = header;
+    trace->records = (const ec_trace_record_t*) ((const char*) map + header->header_size);
+    trace->count = ((size_t) st.st_size - header->header_size) / header->record_size;
+    trace->map_size = (size_t) st.st_size;
+    madvise(map, trace->map_size, MADV_SEQUENTIAL);
+    return EXIT_SUCCESS;
+}
+
+void ec_trace_unmap(ec_trace_t* trace) {
+    if (trace->header != NULL)
+        munmap((void*) trace->header, trace->map_size);
+    memset(trace, 0, sizeof(*trace));
+}
@@ -0,0 +1,70 @@
+#ifndef EC_TRACE_H
+#define EC_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary EC trace: a 32-byte header followed by fixed 16-byte records in
+// host byte order (little-endian on every machine this runs on), so a
+// trace can be mmapped and indexed as an array. A crash can at worst leave
+// a partial record at the end, which readers ignore.
+#define EC_TRACE_MAGIC "CLVTRACE"
+#define EC_TRACE_VERSION 1
+
+typedef struct {
+    char magic[8];                  // EC_TRACE_MAGIC, not NUL-terminated
+    uint16_t version;
+    uint16_t header_size;           // sizeof(ec_trace_header_t)
+    uint16_t record_size;           // sizeof(ec_trace_record_t)
+    uint16_t reserved;
+    uint64_t started_realtime_ns;   // wall clock when recording started
+    uint64_t started_monotonic_ns;  // CLOCK_MONOTONIC matching t_ns == 0
+} ec_trace_header_t;
+
+typedef enum {
+    EC_TRACE_SAMPLE = 1,            // one worker sample
+    EC_TRACE_DUTY_WRITE = 2         // fan duty command sent to the EC
+} ec_trace_kind_t;
+
+typedef struct {
+    uint64_t t_ns;                  // since started_monotonic_ns
+    uint8_t kind;                   // ec_trace_kind_t
+    uint8_t cpu_temp;               // °C, samples only
+    uint8_t gpu_temp;               // °C, samples only
+    uint8_t fan_duty;               // percent: read back or written
+    uint16_t fan_rpms;              // samples only
+    uint8_t status;                 // EXIT_SUCCESS or EXIT_FAILURE of the write
+    uint8_t reserved;
+} ec_trace_record_t;
+
+typedef struct ec_trace_writer ec_trace_writer_t;
+
+// Create (truncate) a trace file and write its header, NULL on error.
+// Opened as the real user and never through a symlink.
+ec_trace_writer_t* ec_trace_create(const char* path);
+
+// Append a record stamped with the current time; buffered
+int ec_trace_append(ec_trace_writer_t* writer, ec_trace_record_t* record);
+
+// Write buffered records to the file
+int ec_trace_flush(ec_trace_writer_t* writer);
+
+// Flush and close
+void ec_trace_close(ec_trace_writer_t* writer);
+
+// Read-only view of a mapped trace
+typedef struct {
+    const ec_trace_header_t* header;
+    const ec_trace_record_t* records;
+    size_t count;
+    size_t map_size;
+} ec_trace_t;
+
+// Map and validate a trace, opened like ec_trace_create();
+// EXIT_SUCCESS or EXIT_FAILURE
+int ec_trace_map(const char* path, ec_trace_t* trace);
+
+// Release a mapped trace
+void ec_trace_unmap(ec_trace_t* trace);
+
+#endif // EC_TRACE_H
@@ -0,0 +1,141 @@
+#include "fan_pid.h"
+#include "ec_stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Longest gap between updates worth integrating over, e.g. after a suspend
+#define FAN_PID_MAX_DT_MS 10000
+
+// Fastest temperature change believed, °C/s
+#define FAN_PID_MAX_RATE_C 1000
+
+#define FAN_PID_FULL ((int64_t) 100 << FAN_PID_SHIFT)
+
+static fan_pid_config_t pid_config = {
+        .kp = FAN_PID_FIX(8.0),
+        .ki = FAN_PID_FIX(1.0),
+        .kd = FAN_PID_FIX(6.0),
+        .d_filter_ms = 2000,
+        .rise_pct_s = 25,
+        .fall_pct_s = 5,
+        .min_step = 2
+};
+
+fan_pid_config_t* fan_pid_config(void) {
+    return &pid_config;
+}
+
+int fan_pid_parse_gains(const char* spec) {
+    double kp, ki, kd;
+    char trailing;
+    if (sscanf(spec, "%lf,%lf,%lf%c", &kp, &ki, &kd, &trailing) != 3)
+        return EXIT_FAILURE;
+    if (kp < 0 || ki < 0 || kd < 0 || kp > 100 || ki > 100 || kd > 100)
+        return EXIT_FAILURE;
+    pid_config.kp = FAN_PID_FIX(kp);
+    pid_config.ki = FAN_PID_FIX(ki);
+    pid_config.kd = FAN_PID_FIX(kd);
+    return EXIT_SUCCESS;
+}
+
+void fan_pid_reset(fan_pid_t* pid) {
+    pid->primed = 0;
+}
+
+static int64_t pid_clamp(int64_t value, int64_t low, int64_t high) {
+    return value < low ? low : value > high ? high : value;
+}
+
+// Overshoot and settling time of each excursion from the target. Below
+// the target with the fan backed off completely counts as on target:
+// there is nothing left for the controller to do.
+static void pid_track(fan_pid_t* pid, int temp, int target, uint64_t now_ns) {
+    ec_controller_stats_t* stats = &ec_stats_get()->controller;
+    stats->updates++;
+    int in_band = temp <= target + FAN_PID_SETTLE_BAND_C
+            && (temp >= target - FAN_PID_SETTLE_BAND_C || pid->output == 0);
+    if (pid->settled) {
+        if (in_band)
+            return;
+        pid->settled = 0;
+        pid->excursion_ns = now_ns;
+        pid->in_band_ns = 0;
+        pid->peak_c = 0;
+        stats->excursions++;
+        stats->last_overshoot_c = 0;
+    }
+    if (temp - target > pid->peak_c) {
+        pid->peak_c = temp - target;
+        stats->last_overshoot_c = pid->peak_c;
+        if (pid->peak_c > stats->max_overshoot_c)
+            stats->max_overshoot_c = pid->peak_c;
+    }
+    if (!in_band) {
+        pid->in_band_ns = 0;
+        return;
+    }
+    if (pid->in_band_ns == 0)
+        pid->in_band_ns = now_ns;
+    if (now_ns - pid->in_band_ns >= (uint64_t) FAN_PID_SETTLE_HOLD_MS * 1000000ULL) {
+        pid->settled = 1;
+        stats->settled++;
+        ec_histogram_record(&stats->settling, pid->in_band_ns - pid->excursion_ns);
+    }
+}
+
+int fan_pid_update(fan_pid_t* pid, int temp, int target, int duty, uint64_t now_ns) {
+    const fan_pid_config_t* config = &pid_config;
+    int64_t error = (int64_t) (temp - target) << FAN_PID_SHIFT;
+    int64_t p = (config->kp * error) >> FAN_PID_SHIFT;
+
+    if (!pid->primed) {
+        // Bumpless start: pick the integral that reproduces the current
+        // duty, but no more than the duty itself so a cold start does not
+        // bank fan speed it will have to unwind later
+        pid->primed = 1;
+        pid->prev_temp = temp;
+        pid->prev_ns = now_ns;
+        pid->derivative = 0;
+        pid->output = (int32_t) pid_clamp((int64_t) duty << FAN_PID_SHIFT, 0, FAN_PID_FULL);
+        pid->integral = (int32_t) pid_clamp(pid->output - p, 0, pid->output);
+        pid->duty = duty;
+        pid->settled = 1;
+        pid_track(pid, temp, target, now_ns);
+        return pid->duty;
+    }
+    if (now_ns <= pid->prev_ns)
+        return pid->duty;
+    int64_t dt_ms = (int64_t) ((now_ns - pid->prev_ns) / 1000000ULL);
+    if (dt_ms < 1) dt_ms = 1;
+    if (dt_ms > FAN_PID_MAX_DT_MS) dt_ms = FAN_PID_MAX_DT_MS;
+
+    // Derivative of the measurement, low-passed over d_filter_ms
+    int64_t rate = ((int64_t) (temp - pid->prev_temp) << FAN_PID_SHIFT) * 1000 / dt_ms;
+    rate = pid_clamp(rate, -((int64_t) FAN_PID_MAX_RATE_C << FAN_PID_SHIFT),
+            (int64_t) FAN_PID_MAX_RATE_C << FAN_PID_SHIFT);
+    pid->derivative += (int32_t) ((rate - pid->derivative) * dt_ms
+            / ((int64_t) config->d_filter_ms + dt_ms));
+    int64_t d = (config->kd * (int64_t) pid->derivative) >> FAN_PID_SHIFT;
+
+    // Integrate, unless that only drives the output further into saturation
+    int64_t integral = pid->integral + ((config->ki * error) >> FAN_PID_SHIFT) * dt_ms / 1000;
+    int64_t unsaturated = p + integral + d;
+    if ((unsaturated > FAN_PID_FULL && error > 0) || (unsaturated < 0 && error < 0))
+        integral = pid->integral;
+    pid->integral = (int32_t) pid_clamp(integral, 0, FAN_PID_FULL);
+
+    // Slew towards the new output at the configured rates
+    int64_t wanted = pid_clamp(p + pid->integral + d, 0, FAN_PID_FULL);
+    int64_t rise = ((int64_t) config->rise_pct_s << FAN_PID_SHIFT) * dt_ms / 1000;
+    int64_t fall = ((int64_t) config->fall_pct_s << FAN_PID_SHIFT) * dt_ms / 1000;
+    pid->output = (int32_t) pid_clamp(wanted, pid->output - fall, pid->output + rise);
+
+    int next = (int) ((pid->output + FAN_PID_ONE / 2) >> FAN_PID_SHIFT);
+    if (abs(next - pid->duty) >= config->min_step
+            || (next != pid->duty && (next == 0 || next == 100)))
+        pid->duty = next;
+    pid->prev_temp = temp;
+    pid->prev_ns = now_ns;
+    pid_track(pid, temp, target, now_ns);
+    return pid->duty;
+}
@@ -0,0 +1,65 @@
+#ifndef FAN_PID_H
+#define FAN_PID_H
+
+#include <stdint.h>
+
+// Fixed-point PID fan controller. Gains, state and output are Q16.16, so
+// an update is a handful of integer multiplies with 64-bit intermediates.
+//
+// The error is the hottest sensor minus the target, positive meaning
+// more fan. The derivative acts on the measurement (no kick when the
+// target changes) through a first-order low-pass, since the EC reports
+// whole degrees. The integral stops growing while the output is pinned
+// at 0% or 100% in the direction of the error (anti-windup), and the
+// output slews at a bounded rate in each direction. A new duty is only
+// handed out when it differs from the last one by min_step, to keep EC
+// writes down.
+#define FAN_PID_SHIFT 16
+#define FAN_PID_ONE (1 << FAN_PID_SHIFT)
+#define FAN_PID_FIX(x) ((int32_t) ((x) * (double) FAN_PID_ONE))
+
+// Settling metrics: within this many °C of the target counts as on
+// target, and staying there this long counts as settled
+#define FAN_PID_SETTLE_BAND_C 2
+#define FAN_PID_SETTLE_HOLD_MS 10000
+
+typedef struct {
+    int32_t kp;               // %/°C, Q16.16
+    int32_t ki;               // %/(°C·s), Q16.16
+    int32_t kd;               // %/(°C/s), Q16.16
+    unsigned int d_filter_ms; // derivative low-pass time constant
+    unsigned int rise_pct_s;  // fastest duty increase, %/s
+    unsigned int fall_pct_s;  // fastest duty decrease, %/s
+    int min_step;             // smallest duty change worth a write, %
+} fan_pid_config_t;
+
+typedef struct {
+    int primed;
+    int prev_temp;
+    uint64_t prev_ns;
+    int32_t integral;         // %, Q16.16
+    int32_t derivative;       // filtered d(temp)/dt, °C/s Q16.16
+    int32_t output;           // rate-limited output, %, Q16.16
+    int duty;                 // last duty handed out
+    // settling metrics
+    int settled;
+    uint64_t excursion_ns;    // when the temperature left the band
+    uint64_t in_band_ns;      // when it last came back into the band, 0 if outside
+    int peak_c;               // highest temperature above target this excursion
+} fan_pid_t;
+
+// Gains and limits used by fan_pid_update()
+fan_pid_config_t* fan_pid_config(void);
+
+// Parse "kp,ki,kd" into the configuration. EXIT_SUCCESS or EXIT_FAILURE.
+int fan_pid_parse_gains(const char* spec);
+
+// Forget the controller state; the next update starts bumplessly from
+// whatever duty the fan is at then
+void fan_pid_reset(fan_pid_t* pid);
+
+// Run the controller for a sample of `temp` taken at `now_ns`, with the
+// fan currently at `duty`. Returns the duty to run the fan at.
+int fan_pid_update(fan_pid_t* pid, int temp, int target, int duty, uint64_t now_ns);
+
+#endif // FAN_PID_H
@@ -38,7 +38,28 @@ echo "Compiling test version..."
 # Compile the simple test
 gcc -o "$BUILD_DIR/test_runner" \
     tests/simple_test.c \
-    -Wall -std=gnu99 -lm
+    "$SRC_DIR/ec_stats.c" \
+    "$SRC_DIR/ec_backend.c" \
+    "$SRC_DIR/ec_port.c" \
+    "$SRC_DIR/ec_sysfs.c" \
+    "$SRC_DIR/ec_mock.c" \
+    "$SRC_DIR/ec_cache.c" \
+    "$SRC_DIR/ec_lock.c" \
+    "$SRC_DIR/ec_snapshot.c" \
+    "$SRC_DIR/ec_sim.c" \
+    "$SRC_DIR/ec_trace.c" \
+    "$SRC_DIR/ec_loop.c" \
+    "$SRC_DIR/ec_telemetry.c" \
+    "$SRC_DIR/ec_command.c" \
+    "$SRC_DIR/ec_shm.c" \
+    "$SRC_DIR/ec_instance.c" \
+    "$SRC_DIR/ec_daemon.c" \
+    "$SRC_DIR/ec_rt.c" \
+    "$SRC_DIR/ec_power.c" \
+    "$SRC_DIR/fan_pid.c" \
+    -I"$SRC_DIR" -DEC_SYSFS_PATH="\"$BUILD_DIR/ec_io\"" -DEC_DEVPORT_PATH="\"$BUILD_DIR/ec_port\"" -DEC_SHM_NAME="\"/clevo-indicator-test-$$\"" -DEC_INSTANCE_NAME="\"clevo-indicator-test-$$\"" \
+    -DEC_SYS_MODULE_PATH="\"$BUILD_DIR/ec_sys\"" -DEC_BACKEND_CACHE_PATH="\"$BUILD_DIR/backend\"" \
+    -DEC_DAEMON_SOCKET_PATH="\"$BUILD_DIR/daemon.sock\"" -DEC_LOCK_PATH="\"$BUILD_DIR/ec.lock\"" -DEC_POWER_SUPPLY_PATH="\"$BUILD_DIR/power_supply\"" -Wall -std=gnu99 -lm
 
 if [ $? -eq 0 ]; then
     echo -e "${GREEN}Test compilation successful${NC}"
@@ -3,6 +3,37 @@
 #include <string.h>
 #include <time.h>
 #include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <poll.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "ec_backend.h"
+#include "ec_cache.h"
+#include "ec_command.h"
+#include "ec_daemon.h"
+#include "ec_instance.h"
+#include "ec_shm.h"
+#include "ec_lock.h"
+#include "ec_loop.h"
+#include "ec_power.h"
+#include "ec_rt.h"
+#include "ec_sim.h"
+#include "ec_snapshot.h"
+#include "ec_trace.h"
+#include "fan_pid.h"
+#include "ec_stats.h"
+#include "ec_telemetry.h"
 
 // Test configuration
 #define TEST_MODE 1
@@ -151,7 +182,1076 @@ void test_edge_cases(void) {
     test_assert_int_equal(0, calculate_fan_rpms(-1, 0), "calculate_fan_rpms negative");
 }
 
+void test_histogram(void) {
+    printf("Testing latency histogram...\n");
+    ec_histogram_t hist;
+    ec_histogram_reset(&hist);
+    test_assert_int_equal(0, (int) ec_histogram_percentile(&hist, 50.0), "empty histogram percentile");
+
+    for (int i = 1; i <= 100; i++) {
+        ec_histogram_record(&hist, (uint64_t) i * 1000); // 1..100 us
+    }
+    test_assert_int_equal(100, (int) hist.count, "histogram count");
+    test_assert_int_equal(1000, (int) hist.min_ns, "histogram min");
+    test_assert_int_equal(100000, (int) hist.max_ns, "histogram max");
+    test_assert_int_equal(100000, (int) ec_histogram_percentile(&hist, 100.0), "histogram p100 is max");
+
+    // Log-linear buckets keep the relative error within one sub-bucket
+    uint64_t p50 = ec_histogram_percentile(&hist, 50.0);
+    test_assert_true(p50 >= 50000 && p50 <= 50000 * 5 / 4, "histogram p50 within bucket error");
+    uint64_t p99 = ec_histogram_percentile(&hist, 99.0);
+    test_assert_true(p99 >= 99000 && p99 <= 100000, "histogram p99 within bucket error");
+
+    // Small and huge values land in valid buckets
+    ec_histogram_record(&hist, 0);
+    ec_histogram_record(&hist, UINT64_MAX / 2);
+    test_assert_int_equal(102, (int) hist.count, "histogram extreme values recorded");
+}
+
+void test_op_stats(void) {
+    printf("Testing EC operation statistics...\n");
+    static ec_stats_t storage;
+    ec_stats_record(EC_OP_READ, 5000, 3, 0);
+    ec_stats_attach(&storage);
+    test_assert_true(ec_stats_get() == &storage, "stats attached to caller storage");
+    test_assert_int_equal(1, (int) storage.ops[EC_OP_READ].calls, "stats carried over on attach");
+
+    ec_stats_record(EC_OP_READ, 7000, 3, 1);
+    ec_stats_record_retry(EC_OP_READ);
+    ec_stats_record(EC_OP_SYSFS_READ, 20000, 256, 0);
+    test_assert_int_equal(2, (int) storage.ops[EC_OP_READ].calls, "read calls");
+    test_assert_int_equal(6, (int) storage.ops[EC_OP_READ].bytes, "read bytes");
+    test_assert_int_equal(1, (int) storage.ops[EC_OP_READ].timeouts, "read timeouts");
+    test_assert_int_equal(1, (int) storage.ops[EC_OP_READ].errors, "read with timeout counts as error");
+    test_assert_int_equal(1, (int) storage.ops[EC_OP_READ].retries, "read retries");
+    test_assert_int_equal(256, (int) storage.ops[EC_OP_SYSFS_READ].bytes, "sysfs bytes");
+    test_assert_int_equal(0, (int) storage.ops[EC_OP_WRITE].calls, "untouched op stays empty");
+}
+
+void test_mock_backend(void) {
+    printf("Testing mock EC backend...\n");
+    ec_backend_t* backend = ec_backend_open(EC_BACKEND_MOCK);
+    test_assert_true(backend != NULL, "mock backend opens");
+    test_assert_int_equal(EC_BACKEND_MOCK, ec_backend_parse("mock"), "parse backend name");
+    test_assert_int_equal(-1, ec_backend_parse("bogus"), "parse unknown backend name");
+
+    const uint8_t regs[] = { EC_REG_CPU_TEMP, EC_REG_GPU_TEMP, EC_REG_FAN_DUTY };
+    uint8_t values[3];
+    ec_mock_set_register(backend, EC_REG_CPU_TEMP, 71);
+    test_assert_int_equal(EXIT_SUCCESS, ec_backend_read_batch(backend, regs, values, 3), "mock read batch");
+    test_assert_int_equal(71, values[0], "mock read batch CPU temp");
+    test_assert_int_equal(50, values[1], "mock read batch GPU temp");
+
+    test_assert_int_equal(EXIT_SUCCESS, ec_backend_write(backend, EC_CMD_FAN_DUTY, EC_FAN_DUTY_PORT, 204), "mock fan duty write");
+    uint8_t all[EC_REG_SIZE];
+    ec_backend_snapshot(backend, all);
+    test_assert_int_equal(204, all[EC_REG_FAN_DUTY], "fan duty write lands in duty register");
+    test_assert_int_equal(EXIT_FAILURE, ec_backend_write(backend, 0x42, 0x00, 0), "mock rejects unknown command");
+    test_assert_int_equal(EC_HEALTH_OK, ec_backend_health(backend), "mock health");
+    ec_backend_close(backend);
+}
+
+void test_sysfs_backend(void) {
+    printf("Testing sysfs EC backend...\n");
+    // Fake debugfs file where every register holds its own address
+    unsigned char image[0x100];
+    for (int i = 0; i < 0x100; i++) image[i] = (unsigned char) i;
+    FILE* fp = fopen(EC_SYSFS_PATH, "wb");
+    test_assert_true(fp != NULL, "create fake ec_sys io file");
+    fwrite(image, 1, sizeof(image), fp);
+    fclose(fp);
+
+    ec_backend_t* backend = ec_backend_open(EC_BACKEND_SYSFS);
+    test_assert_true(backend != NULL, "sysfs backend opens");
+
+    ec_op_stats_t* sysfs_stats = &ec_stats_get()->ops[EC_OP_SYSFS_READ];
+    uint64_t syscalls_before = sysfs_stats->syscalls;
+    uint64_t bytes_before = sysfs_stats->bytes;
+    const uint8_t regs[] = { EC_REG_CPU_TEMP, EC_REG_GPU_TEMP, EC_REG_FAN_DUTY, EC_REG_FAN_RPMS_HI, EC_REG_FAN_RPMS_LO };
+    uint8_t values[5];
+    test_assert_int_equal(EXIT_SUCCESS, ec_backend_read_batch(backend, regs, values, 5), "sysfs read batch");
+    test_assert_int_equal(EC_REG_CPU_TEMP, values[0], "sysfs CPU temp register");
+    test_assert_int_equal(EC_REG_FAN_RPMS_LO, values[4], "sysfs RPM low register");
+    // 0x07 and 0xCD-0xD1 are two ranges: two preads, six bytes
+    test_assert_int_equal(2, (int) (sysfs_stats->syscalls - syscalls_before), "sysfs sample takes two preads");
+    test_assert_int_equal(6, (int) (sysfs_stats->bytes - bytes_before), "sysfs sample reads only planned bytes");
+
+    uint8_t all[0x100];
+    test_assert_int_equal(EXIT_SUCCESS, ec_backend_snapshot(backend, all), "sysfs snapshot");
+    test_assert_int_equal(0xAB, all[0xAB], "sysfs snapshot content");
+
+    // The budgeted sweep reads sub-ranges and leaves the sample plan sparse
+    ec_snapshot_reset();
+    ec_snapshot_set_budget_us(2000);
+    test_assert_int_equal(0, ec_snapshot_step(backend), "sysfs sweep takes several steps");
+    int steps = 1;
+    while (ec_snapshot_step(backend) != 1 && steps < 1000)
+        steps++;
+    test_assert_int_equal(0xAB, ec_snapshot_get(NULL, NULL)[0xAB], "sysfs sweep content");
+    ec_snapshot_set_budget_us(0);
+    ec_snapshot_reset();
+    syscalls_before = sysfs_stats->syscalls;
+    bytes_before = sysfs_stats->bytes;
+    ec_backend_read_batch(backend, regs, values, 5);
+    test_assert_int_equal(6, (int) (sysfs_stats->bytes - bytes_before), "sweep kept out of the sample plan");
+
+    unlink(EC_SYSFS_PATH);
+    test_assert_int_equal(EXIT_SUCCESS, ec_backend_read_batch(backend, regs, values, 5), "sysfs keeps its fd after unlink");
+    ec_backend_close(backend);
+    test_assert_true(ec_backend_open(EC_BACKEND_SYSFS) == NULL, "sysfs backend unavailable without file");
+}
+
+void test_register_cache(void) {
+    printf("Testing shadow register cache...\n");
+    ec_cache_set_max_age(EC_REG_GPU_TEMP, 60000);
+    ec_backend_t* mock = ec_backend_open(EC_BACKEND_MOCK);
+    ec_backend_t* cache = ec_cache_open(mock);
+    test_assert_true(cache != NULL, "cache wraps backend");
+    test_assert_int_equal(EC_BACKEND_MOCK, cache->type, "cache reports inner type");
+
+    ec_stats_t* stats = ec_stats_get();
+    const uint8_t regs[] = { EC_REG_CPU_TEMP, EC_REG_GPU_TEMP };
+    uint8_t values[2];
+    uint64_t hits = stats->cache_hits;
+    uint64_t misses = stats->cache_misses;
+    ec_backend_read_batch(cache, regs, values, 2);
+    test_assert_int_equal(2, (int) (stats->cache_misses - misses), "first read misses");
+
+    ec_mock_set_register(mock, EC_REG_CPU_TEMP, 80);
+    ec_mock_set_register(mock, EC_REG_GPU_TEMP, 81);
+    ec_backend_read_batch(cache, regs, values, 2);
+    test_assert_int_equal(80, values[0], "CPU temp (budget 0) always fresh");
+    test_assert_int_equal(50, values[1], "GPU temp served from cache within budget");
+    test_assert_int_equal(1, (int) (stats->cache_hits - hits), "one cache hit");
+
+    // Bus time is only the inner batch: nothing when all is cached, and a
+    // register asked for twice is one miss
+    ec_op_stats_t* batch = &stats->ops[EC_OP_BATCH];
+    uint64_t batches = batch->calls;
+    uint64_t batch_bytes = batch->bytes;
+    ec_backend_read_batch(cache, &regs[1], values, 1);
+    test_assert_true(batch->calls == batches, "cached batch is not bus time");
+    misses = stats->cache_misses;
+    const uint8_t twice[] = { EC_REG_CPU_TEMP, EC_REG_CPU_TEMP };
+    ec_backend_read_batch(cache, twice, values, 2);
+    test_assert_int_equal(1, (int) (stats->cache_misses - misses), "duplicate register one miss");
+    test_assert_int_equal(1, (int) (batch->bytes - batch_bytes), "one register on the bus");
+
+    ec_cache_invalidate(cache, EC_REG_GPU_TEMP);
+    ec_backend_read_batch(cache, regs, values, 2);
+    test_assert_int_equal(81, values[1], "invalidated register re-read");
+
+    ec_backend_write(cache, EC_CMD_FAN_DUTY, EC_FAN_DUTY_PORT, 100);
+    const uint8_t duty_reg = EC_REG_FAN_DUTY;
+    uint8_t duty = 0;
+    ec_backend_read_batch(cache, &duty_reg, &duty, 1);
+    test_assert_int_equal(100, duty, "duty write invalidates cached duty");
+    ec_backend_close(cache);
+}
+
+void test_duty_write_pipeline(void) {
+    printf("Testing fan duty write pipeline...\n");
+    ec_backend_t* mock = ec_backend_open(EC_BACKEND_MOCK);
+    ec_backend_t* cache = ec_cache_open(mock);
+    ec_stats_t* stats = ec_stats_get();
+    uint64_t issued = stats->duty_writes_issued;
+    uint64_t suppressed = stats->duty_writes_suppressed;
+    uint64_t confirmed = stats->duty_writes_confirmed;
+    uint64_t mismatched = stats->duty_writes_mismatched;
+    const uint8_t duty_reg = EC_REG_FAN_DUTY;
+    uint8_t duty = 0;
+
+    ec_backend_write(cache, EC_CMD_FAN_DUTY, EC_FAN_DUTY_PORT, 128);
+    ec_backend_write(cache, EC_CMD_FAN_DUTY, EC_FAN_DUTY_PORT, 128);
+    test_assert_int_equal(1, (int) (stats->duty_writes_issued - issued), "first duty write issued");
+    test_assert_int_equal(1, (int) (stats->duty_writes_suppressed - suppressed), "repeated duty write suppressed");
+
+    ec_backend_read_batch(cache, &duty_reg, &duty, 1);
+    test_assert_int_equal(1, (int) (stats->duty_writes_confirmed - confirmed), "next read confirms the write");
+    ec_backend_write(cache, EC_CMD_FAN_DUTY, EC_FAN_DUTY_PORT, 128);
+    test_assert_int_equal(2, (int) (stats->duty_writes_suppressed - suppressed), "confirmed duty suppressed");
+
+    // The EC overrides our duty: the read-back reports a mismatch
+    ec_backend_write(cache, EC_CMD_FAN_DUTY, EC_FAN_DUTY_PORT, 200);
+    ec_mock_set_register(mock, EC_REG_FAN_DUTY, 90);
+    ec_backend_read_batch(cache, &duty_reg, &duty, 1);
+    test_assert_int_equal(1, (int) (stats->duty_writes_mismatched - mismatched), "read-back mismatch counted");
+    ec_backend_write(cache, EC_CMD_FAN_DUTY, EC_FAN_DUTY_PORT, 200);
+    test_assert_int_equal(3, (int) (stats->duty_writes_issued - issued), "duty re-issued after mismatch");
+    ec_backend_close(cache);
+
+    // The EC's own automatic duty is not ours: writing the same value
+    // still has to reach the EC to take manual control
+    mock = ec_backend_open(EC_BACKEND_MOCK);
+    cache = ec_cache_open(mock);
+    ec_mock_set_register(mock, EC_REG_FAN_DUTY, 153);
+    ec_backend_read_batch(cache, &duty_reg, &duty, 1);
+    issued = stats->duty_writes_issued;
+    ec_backend_write(cache, EC_CMD_FAN_DUTY, EC_FAN_DUTY_PORT, 153);
+    test_assert_int_equal(1, (int) (stats->duty_writes_issued - issued), "first write matching EC auto duty issued");
+    ec_backend_close(cache);
+}
+
 // Test runner
+void test_bus_lock(void) {
+    printf("Testing cross-process EC bus lock...\n");
+    ec_lock_stats_t* stats = &ec_stats_get()->lock;
+    uint64_t contended = stats->contended;
+
+    test_assert_int_equal(EXIT_SUCCESS, ec_lock_acquire(), "uncontended lock acquired");
+    pid_t child = fork();
+    if (child == 0) {
+        // The child opens its own description, so it has to wait for us
+        _exit(ec_lock_acquire() == EXIT_SUCCESS && ec_stats_get()->lock.contended > contended ? 0 : 1);
+    }
+    usleep(20 * 1000);
+    ec_lock_release();
+    int status = 0;
+    waitpid(child, &status, 0);
+    test_assert_int_equal(0, WEXITSTATUS(status), "second process waits for the lock");
+
+    struct stat st;
+    test_assert_int_equal(0, stat(EC_LOCK_PATH, &st), "lock file created");
+    test_assert_int_equal(0, (int) (st.st_mode & 0007), "lock file closed to other users");
+
+    // A short timeout gives up instead of stalling the caller
+    int ready[2];
+    test_assert_int_equal(0, pipe(ready), "pipe");
+    child = fork();
+    if (child == 0) {
+        ec_lock_acquire();
+        ssize_t written = write(ready[1], "x", 1);
+        usleep(300 * 1000);
+        _exit(written == 1 ? 0 : 1);
+    }
+    char byte;
+    test_assert_int_equal(1, (int) read(ready[0], &byte, 1), "child holds the lock");
+    ec_lock_set_timeout(EC_LOCK_WORKER_TIMEOUT_MS);
+    uint64_t start = ec_stats_now_ns();
+    test_assert_int_equal(EXIT_FAILURE, ec_lock_acquire(), "worker timeout gives up");
+    test_assert_true(ec_stats_now_ns() - start < 200ULL * 1000000ULL, "gave up well within a period");
+    ec_lock_set_timeout(EC_LOCK_TIMEOUT_MS);
+    waitpid(child, &status, 0);
+    close(ready[0]);
+    close(ready[1]);
+
+    // A world-readable lock planted by someone else is refused while it is
+    // held and replaced once it is not; our stale descriptor is noticed
+    if (geteuid() == 0) {
+        unlink(EC_LOCK_PATH);
+        int fd = open(EC_LOCK_PATH, O_RDONLY | O_CREAT, 0644);
+        fchmod(fd, 0666);
+        fchown(fd, 65534, 65534);
+        test_assert_int_equal(0, pipe(ready), "pipe");
+        child = fork();
+        if (child == 0) {
+            flock(fd, LOCK_EX);
+            ssize_t written = write(ready[1], "x", 1);
+            pause();
+            _exit(written == 1 ? 0 : 1);
+        }
+        close(fd);
+        test_assert_int_equal(1, (int) read(ready[0], &byte, 1), "squatter holds the lock");
+        test_assert_int_equal(EXIT_FAILURE, ec_lock_acquire(), "held planted lock refused");
+        test_assert_int_equal(EACCES, errno, "refusal says why");
+        test_assert_int_equal(0, stat(EC_LOCK_PATH, &st), "planted lock left alone");
+        test_assert_int_equal(65534, (int) st.st_uid, "planted lock not replaced while held");
+        kill(child, SIGKILL);
+        waitpid(child, &status, 0);
+        close(ready[0]);
+        close(ready[1]);
+
+        test_assert_int_equal(EXIT_SUCCESS, ec_lock_acquire(), "free planted lock replaced");
+        ec_lock_release();
+        test_assert_int_equal(0, stat(EC_LOCK_PATH, &st), "lock file recreated");
+        test_assert_int_equal(0, (int) st.st_uid, "recreated lock owned by root");
+        test_assert_int_equal(0, (int) (st.st_mode & 0007), "recreated lock closed to others");
+    }
+}
+
+// Port-like backend costing ~100us per register, to exercise budgeted sweeps
+static int slow_reads = 0;
+
+static int slow_read_batch(ec_backend_t* backend, const uint8_t* regs, uint8_t* out, size_t n) {
+    (void) backend;
+    slow_reads++;
+    for (size_t i = 0; i < n; i++)
+        out[i] = (uint8_t) (regs[i] ^ 0x5A);
+    usleep(100 * n);
+    return EXIT_SUCCESS;
+}
+
+static const ec_backend_ops_t slow_ops = {
+        .read_batch = slow_read_batch
+};
+
+void test_incremental_snapshot(void) {
+    printf("Testing budgeted incremental snapshot...\n");
+    ec_backend_t slow = { .ops = &slow_ops, .type = EC_BACKEND_PORT };
+    ec_snapshot_reset();
+    ec_snapshot_set_budget_us(2000);
+
+    uint64_t batch_calls = ec_stats_get()->ops[EC_OP_BATCH].calls;
+    int steps = 0;
+    int published = 0;
+    int early = 0;
+    while (!published && steps < 1000) {
+        published = ec_snapshot_step(&slow) == 1;
+        early |= !published && ec_snapshot_get(NULL, NULL) != NULL;
+        steps++;
+    }
+    test_assert_int_equal(0, early, "nothing published mid-sweep");
+    uint32_t generation = 0;
+    const uint8_t* regs = ec_snapshot_get(&generation, NULL);
+    test_assert_int_equal(1, published, "sweep completes");
+    test_assert_int_equal(1, steps > 1, "sweep spread over several ticks");
+    test_assert_int_equal(1, (int) generation, "first generation");
+    test_assert_int_equal(0xCD ^ 0x5A, regs[0xCD], "snapshot holds register values");
+    test_assert_true(ec_stats_get()->ops[EC_OP_BATCH].calls == batch_calls, "sweep kept out of sample batch stats");
+
+    ec_backend_t* mock = ec_backend_open(EC_BACKEND_MOCK);
+    test_assert_int_equal(1, ec_snapshot_step(mock), "bulk backend publishes in one step");
+    regs = ec_snapshot_get(&generation, NULL);
+    test_assert_int_equal(45, regs[EC_REG_CPU_TEMP], "bulk snapshot from mock");
+    test_assert_int_equal(2, (int) generation, "second generation");
+    ec_backend_close(mock);
+    ec_snapshot_set_budget_us(0);
+    ec_snapshot_reset();
+}
+
+static void write_fake_devport(uint8_t status) {
+    unsigned char image[0x100] = {0};
+    image[0x66] = status;
+    FILE* fp = fopen(EC_DEVPORT_PATH, "wb");
+    test_assert_true(fp != NULL, "create fake /dev/port file");
+    fwrite(image, 1, sizeof(image), fp);
+    fclose(fp);
+}
+
+void test_port_error_policy(void) {
+    printf("Testing port transaction error classification...\n");
+    ec_wait_config_t* config = ec_port_wait_config();
+    ec_wait_config_t saved = *config;
+    config->spin_us = 0;
+    config->timeout_us = 200;
+    config->retry_backoff_us = 10;
+    config->cooldown_ms = 50;
+    ec_stats_t* stats = ec_stats_get();
+    uint64_t ibf_stuck = stats->txn[EC_TXN_IBF_STUCK];
+    uint64_t obf_timeout = stats->txn[EC_TXN_OBF_TIMEOUT];
+    uint64_t cooldown = stats->txn[EC_TXN_COOLDOWN];
+    uint64_t retries = stats->ops[EC_OP_READ].retries;
+    const uint8_t reg = EC_REG_CPU_TEMP;
+    uint8_t value = 0;
+
+    // Input buffer permanently full: the first step fails after its retries
+    write_fake_devport(0x02);
+    ec_backend_t* backend = ec_backend_open(EC_BACKEND_DEVPORT);
+    test_assert_true(backend != NULL, "devport backend opens on fake file");
+    test_assert_int_equal(EXIT_FAILURE, ec_backend_read_batch(backend, &reg, &value, 1), "stuck IBF fails the read");
+    test_assert_int_equal(1, (int) (stats->txn[EC_TXN_IBF_STUCK] - ibf_stuck), "classified as IBF stuck");
+    test_assert_int_equal((int) config->step_retries, (int) (stats->ops[EC_OP_READ].retries - retries), "only the failed step retried");
+    test_assert_int_equal(EXIT_FAILURE, ec_backend_read_batch(backend, &reg, &value, 1), "read rejected during cooldown");
+    test_assert_int_equal(1, (int) (stats->txn[EC_TXN_COOLDOWN] - cooldown), "cooldown rejection counted");
+    test_assert_int_equal(EC_HEALTH_DEGRADED, ec_backend_health(backend), "failed transaction degrades health");
+    ec_backend_close(backend);
+
+    // The fake status byte is overwritten by the 0x80 read command, so
+    // IBF clears but OBF never rises
+    write_fake_devport(0x00);
+    backend = ec_backend_open(EC_BACKEND_DEVPORT);
+    test_assert_int_equal(EXIT_FAILURE, ec_backend_read_batch(backend, &reg, &value, 1), "missing OBF fails the read");
+    test_assert_int_equal(1, (int) (stats->txn[EC_TXN_OBF_TIMEOUT] - obf_timeout), "classified as OBF timeout");
+    ec_backend_close(backend);
+
+    unlink(EC_DEVPORT_PATH);
+    *config = saved;
+}
+
+void test_thermal_simulator(void) {
+    printf("Testing thermal-model EC simulator...\n");
+    ec_sim_config_t* config = ec_sim_config();
+    double saved_scale = config->time_scale;
+    config->time_scale = 0; // manual clock
+    ec_backend_t* sim = ec_backend_open(EC_BACKEND_SIM);
+    test_assert_true(sim != NULL, "sim backend opens");
+    const uint8_t regs[] = { EC_REG_CPU_TEMP, EC_REG_FAN_RPMS_HI, EC_REG_FAN_RPMS_LO };
+    uint8_t values[3];
+    double cpu_c = 0, rpm = 0;
+    uint64_t now_ns = 0;
+
+    // Ten minutes at a low duty, then ten minutes at full duty
+    ec_backend_write(sim, EC_CMD_FAN_DUTY, EC_FAN_DUTY_PORT, 50);
+    ec_sim_advance(sim, 600ULL * 1000000000ULL);
+    ec_backend_read_batch(sim, regs, values, 3);
+    int hot = values[0];
+    test_assert_true(hot > 60, "CPU heats up with the fan slow");
+
+    ec_backend_write(sim, EC_CMD_FAN_DUTY, EC_FAN_DUTY_PORT, 255);
+    ec_sim_advance(sim, 100ULL * 1000000ULL);
+    ec_sim_state(sim, NULL, NULL, NULL, &rpm);
+    test_assert_true(rpm < 0.5 * config->max_rpm, "RPM lags a duty step");
+    ec_sim_advance(sim, 600ULL * 1000000000ULL);
+    ec_backend_read_batch(sim, regs, values, 3);
+    test_assert_true(values[0] < hot - 10, "full duty cools the CPU");
+    int raw_rpm = (values[1] << 8) | values[2];
+    test_assert_true(raw_rpm > 0 && 2156220 / raw_rpm > 4300, "RPM settles at full speed");
+
+    // Register transactions cost simulated handshake time
+    ec_sim_state(sim, &now_ns, &cpu_c, NULL, NULL);
+    ec_backend_read_batch(sim, regs, values, 3);
+    uint64_t after_ns = 0;
+    ec_sim_state(sim, &after_ns, NULL, NULL, NULL);
+    test_assert_true(after_ns - now_ns >= 3 * (2ULL * config->ibf_ns + config->obf_ns), "reads advance the bus clock");
+    ec_backend_close(sim);
+
+    // The simulated clock stays reachable behind the register cache
+    ec_backend_t* cached = ec_cache_open(ec_backend_open(EC_BACKEND_SIM));
+    test_assert_true(ec_cache_inner(cached) != cached, "cache unwraps to the simulator");
+    ec_sim_advance(ec_cache_inner(cached), 5ULL * 1000000000ULL);
+    now_ns = 0;
+    ec_sim_state(ec_cache_inner(cached), &now_ns, NULL, NULL, NULL);
+    test_assert_true(now_ns >= 5ULL * 1000000000ULL, "sim clock read through the cache");
+    ec_backend_close(cached);
+
+    // In wall-clock mode handshakes take real time but no CPU
+    config->time_scale = 1.0;
+    unsigned int saved_slow_every = config->slow_every, saved_slow_ns = config->slow_ns;
+    config->slow_every = 1;
+    config->slow_ns = 20000000;
+    sim = ec_backend_open(EC_BACKEND_SIM);
+    uint64_t wall_start = ec_stats_now_ns();
+    uint64_t cpu_start = ec_power_cpu_ns();
+    ec_backend_read_batch(sim, regs, values, 3);
+    uint64_t wall_ns = ec_stats_now_ns() - wall_start;
+    test_assert_true(wall_ns >= 60000000ULL, "handshakes take wall time");
+    test_assert_true(ec_power_cpu_ns() - cpu_start < wall_ns / 4, "handshakes do not spin");
+    ec_backend_close(sim);
+    config->slow_every = saved_slow_every;
+    config->slow_ns = saved_slow_ns;
+    config->time_scale = saved_scale;
+}
+
+void test_trace_roundtrip(void) {
+    printf("Testing binary EC trace format...\n");
+    const char* path = EC_SYSFS_PATH ".trace";
+    ec_trace_writer_t* writer = ec_trace_create(path);
+    test_assert_true(writer != NULL, "trace created");
+    for (int i = 0; i < 100; i++) {
+        ec_trace_record_t sample = { .kind = EC_TRACE_SAMPLE, .cpu_temp = (uint8_t) (40 + i % 30), .fan_rpms = 2000 };
+        ec_trace_append(writer, &sample);
+    }
+    ec_trace_record_t write = { .kind = EC_TRACE_DUTY_WRITE, .fan_duty = 80, .status = EXIT_SUCCESS };
+    ec_trace_append(writer, &write);
+    ec_trace_close(writer);
+
+    // A crash mid-record leaves a partial tail that readers skip
+    FILE* fp = fopen(path, "ab");
+    fwrite("torn", 1, 4, fp);
+    fclose(fp);
+
+    ec_trace_t trace;
+    test_assert_int_equal(EXIT_SUCCESS, ec_trace_map(path, &trace), "trace maps");
+    test_assert_int_equal(16, (int) sizeof(ec_trace_record_t), "records are 16 bytes");
+    test_assert_int_equal(101, (int) trace.count, "partial record ignored");
+    test_assert_int_equal(69, trace.records[29].cpu_temp, "sample content");
+    test_assert_int_equal(EC_TRACE_DUTY_WRITE, trace.records[100].kind, "write record kind");
+    test_assert_int_equal(80, trace.records[100].fan_duty, "write record duty");
+    test_assert_true(trace.records[100].t_ns >= trace.records[0].t_ns, "timestamps monotonic");
+    ec_trace_unmap(&trace);
+
+    // A symlink planted at the path is refused, not followed
+    const char* link_path = EC_SYSFS_PATH ".trace-link";
+    unlink(link_path);
+    test_assert_int_equal(0, symlink(path, link_path), "symlink planted");
+    test_assert_true(ec_trace_create(link_path) == NULL, "trace refuses to follow a symlink");
+    test_assert_int_equal(EXIT_FAILURE, ec_trace_map(link_path, &trace), "replay refuses a symlink");
+    unlink(link_path);
+    unlink(path);
+}
+
+void test_worker_loop(void) {
+    printf("Testing adaptive worker event loop...\n");
+    test_assert_int_equal(EC_LOOP_MIN_PERIOD_MS, (int) ec_loop_adapt_period(2000, 50, 48, 65), "rising temperature samples fast");
+    test_assert_int_equal(EC_LOOP_MIN_PERIOD_MS, (int) ec_loop_adapt_period(2000, 63, 63, 65), "near target samples fast");
+    test_assert_int_equal(300, (int) ec_loop_adapt_period(200, 45, 45, 65), "idle and stable backs off");
+    test_assert_int_equal(EC_LOOP_MAX_PERIOD_MS, (int) ec_loop_adapt_period(1900, 45, 45, 65), "back-off is capped");
+    test_assert_int_equal(EC_LOOP_DEFAULT_PERIOD_MS, (int) ec_loop_adapt_period(100, 50, 52, 65), "cooling uses the default pace");
+
+    // ±1 °C of EC jitter on an idle machine must not keep it sampling fast
+    unsigned int period = EC_LOOP_DEFAULT_PERIOD_MS;
+    for (int i = 0; i < 6; i++) {
+        unsigned int next = ec_loop_adapt_period(period, 45 + (i & 1), 45, 65);
+        test_assert_true(next > period, "jittering temperature keeps backing off");
+        period = next;
+    }
+    test_assert_int_equal(EC_LOOP_MAX_PERIOD_MS, (int) period, "jitter reaches the slowest pace");
+    test_assert_int_equal(EC_LOOP_MIN_PERIOD_MS, (int) ec_loop_adapt_period(period, 47, 45, 65), "drift of two degrees samples fast");
+
+    int wake_fd = ec_loop_wake_fd();
+    ec_loop_t loop;
+    test_assert_int_equal(EXIT_SUCCESS, ec_loop_open(&loop, wake_fd, NULL), "loop opens");
+    ec_loop_set_period(&loop, EC_LOOP_MAX_PERIOD_MS);
+    uint64_t start = ec_stats_now_ns();
+    ec_loop_wake(wake_fd);
+    test_assert_int_equal(EC_LOOP_WAKE, ec_loop_wait(&loop), "wake eventfd interrupts the period");
+    test_assert_true(ec_stats_now_ns() - start < 100000000ULL, "command handled without waiting for the tick");
+    ec_loop_set_period(&loop, 10);
+    test_assert_int_equal(EC_LOOP_TIMER, ec_loop_wait(&loop), "timer fires at the new period");
+    test_assert_int_equal(10, (int) ec_stats_get()->loop.period_ms, "current period exported");
+
+    // A child's pidfd wakes the loop as soon as it exits
+    pid_t child = fork();
+    if (child == 0) {
+        usleep(20 * 1000);
+        _exit(0);
+    }
+    int pidfd = ec_loop_pidfd(child);
+    if (pidfd >= 0) {
+        ec_loop_add_fd(&loop, pidfd);
+        ec_loop_set_period(&loop, EC_LOOP_MAX_PERIOD_MS);
+        test_assert_int_equal(EC_LOOP_FD, ec_loop_wait(&loop), "pidfd reports the exit");
+        test_assert_int_equal(pidfd, loop.last_fd, "exit reported on the pidfd");
+        close(pidfd);
+    }
+    waitpid(child, NULL, 0);
+    ec_loop_close(&loop);
+    close(wake_fd);
+}
+
+void test_telemetry_seqlock(void) {
+    printf("Testing seqlock telemetry snapshot...\n");
+    ec_seqlock_t* lock = mmap(NULL, sizeof(*lock), PROT_READ | PROT_WRITE,
+            MAP_ANON | MAP_SHARED, -1, 0);
+    test_assert_true(lock != MAP_FAILED, "shared page mapped");
+    test_assert_int_equal(0, (int) ((uintptr_t) lock % EC_CACHELINE), "snapshot starts a cache line");
+    test_assert_int_equal(EC_CACHELINE, (int) sizeof(ec_seqlock_t), "snapshot fills one cache line");
+
+    // Writer keeps every field of a sample equal; a torn read would mix two
+    pid_t writer = fork();
+    if (writer == 0) {
+        ec_telemetry_t sample;
+        memset(&sample, 0, sizeof(sample));
+        for (int i = 1; i <= 200000; i++) {
+            sample.sequence = (uint64_t) i;
+            sample.sampled_ns = (uint64_t) i;
+            sample.cpu_temp = sample.gpu_temp = sample.fan_duty = sample.fan_rpms = i;
+            ec_telemetry_publish(lock, &sample);
+        }
+        _exit(0);
+    }
+    int torn = 0;
+    uint64_t last_sequence = 0;
+    int went_backwards = 0;
+    for (int i = 0; i < 200000; i++) {
+        ec_telemetry_t sample;
+        ec_telemetry_read(lock, &sample);
+        int v = (int) sample.sequence;
+        if (sample.cpu_temp != v || sample.gpu_temp != v || sample.fan_duty != v
+                || sample.fan_rpms != v || sample.sampled_ns != sample.sequence)
+            torn++;
+        if (sample.sequence < last_sequence)
+            went_backwards++;
+        last_sequence = sample.sequence;
+    }
+    waitpid(writer, NULL, 0);
+    test_assert_int_equal(0, torn, "no torn reads");
+    test_assert_int_equal(0, went_backwards, "sequence numbers never go backwards");
+    munmap(lock, sizeof(*lock));
+}
+
+void test_command_ring(void) {
+    printf("Testing UI command ring...\n");
+    static ec_command_ring_t ring;
+    ec_command_t command;
+    uint64_t dropped = ec_stats_get()->commands.dropped;
+
+    test_assert_int_equal(0, ec_command_pop(&ring, &command), "empty ring");
+    ec_command_push(&ring, EC_COMMAND_SET_DUTY, 60);
+    ec_command_push(&ring, EC_COMMAND_SET_DUTY, 90);
+    ec_command_push(&ring, EC_COMMAND_SET_AUTO, 0);
+    test_assert_int_equal(1, ec_command_pop(&ring, &command), "first command");
+    test_assert_int_equal(60, command.value, "commands keep click order");
+    ec_command_pop(&ring, &command);
+    test_assert_int_equal(90, command.value, "fast second click not lost");
+    ec_command_pop(&ring, &command);
+    test_assert_int_equal(EC_COMMAND_SET_AUTO, (int) command.type, "third command");
+    test_assert_true(command.issued_ns > 0, "command stamped at click time");
+
+    for (int i = 0; i < EC_COMMAND_RING_SIZE; i++)
+        ec_command_push(&ring, EC_COMMAND_SET_TARGET, 60 + i);
+    test_assert_int_equal(EXIT_FAILURE, ec_command_push(&ring, EC_COMMAND_SET_TARGET, 99), "full ring refuses");
+    test_assert_int_equal(1, (int) (ec_stats_get()->commands.dropped - dropped), "drop counted");
+    int drained = 0;
+    while (ec_command_pop(&ring, &command))
+        drained++;
+    test_assert_int_equal(EC_COMMAND_RING_SIZE, drained, "ring drains across the wrap");
+}
+
+void test_telemetry_history(void) {
+    printf("Testing telemetry history ring...\n");
+    static ec_history_t history;
+    ec_telemetry_t sample = {0};
+    ec_telemetry_t out[EC_HISTORY_SIZE];
+    uint64_t cursor = 0, lost = 0;
+    double rate = 0;
+
+    test_assert_int_equal(0, (int) ec_history_read(&history, &cursor, out, EC_HISTORY_SIZE, &lost), "empty history");
+    test_assert_int_equal(EXIT_FAILURE, ec_history_temp_rate(&history, 60000000000ULL, &rate, NULL), "no trend from nothing");
+    for (int i = 1; i <= 10; i++) {
+        sample.sequence = i;
+        sample.sampled_ns = (uint64_t) i * 1000000000ULL;
+        sample.cpu_temp = 50 + i;
+        ec_history_append(&history, &sample);
+    }
+    test_assert_int_equal(4, (int) ec_history_read(&history, &cursor, out, 4, &lost), "bounded read");
+    test_assert_int_equal(1, (int) out[0].sequence, "oldest first");
+    test_assert_int_equal(4, (int) cursor, "cursor advanced");
+    test_assert_int_equal(6, (int) ec_history_read(&history, &cursor, out, EC_HISTORY_SIZE, &lost), "rest read");
+    test_assert_int_equal(0, (int) lost, "nothing lost");
+    uint64_t span_ns = 0;
+    test_assert_int_equal(EXIT_SUCCESS, ec_history_temp_rate(&history, 60000000000ULL, &rate, &span_ns), "trend available");
+    test_assert_true(rate > 59.9 && rate < 60.1, "1°C/s is 60°C/min");
+    test_assert_true(span_ns == 9000000000ULL, "trend reports the span it covers");
+
+    // a reader more than a lap behind resumes at the oldest kept sample
+    for (int i = 11; i <= 10 + EC_HISTORY_SIZE + 5; i++) {
+        sample.sequence = i;
+        ec_history_append(&history, &sample);
+    }
+    size_t count = ec_history_read(&history, &cursor, out, EC_HISTORY_SIZE, &lost);
+    test_assert_int_equal(EC_HISTORY_SIZE, (int) count, "full lap read");
+    test_assert_int_equal(5, (int) lost, "lapped samples counted");
+    test_assert_int_equal(16, (int) out[0].sequence, "resumed at the oldest kept sample");
+    test_assert_int_equal((int) ec_history_head(&history), (int) cursor, "caught up");
+}
+
+void test_telemetry_segment(void) {
+    printf("Testing named telemetry segment...\n");
+    ec_shm_t* writer = ec_shm_create();
+    test_assert_true(writer != NULL, "segment created");
+    if (writer == NULL)
+        return;
+    ec_telemetry_t sample = {0};
+    sample.sequence = 1;
+    sample.cpu_temp = 71;
+    sample.fan_duty = 55;
+    ec_telemetry_publish(&writer->telemetry, &sample);
+    ec_history_append(&writer->history, &sample);
+
+    const ec_shm_t* reader = ec_shm_attach();
+    test_assert_true(reader != NULL, "reader attached by name");
+    if (reader != NULL) {
+        ec_telemetry_t seen;
+        ec_telemetry_read(&reader->telemetry, &seen);
+        test_assert_int_equal(71, seen.cpu_temp, "reader sees the live sample");
+        test_assert_int_equal(EC_SHM_ABI_VERSION, (int) reader->header.abi_version, "abi version");
+        test_assert_int_equal(getpid(), reader->header.writer_pid, "writer pid");
+        uint64_t cursor = 0;
+        test_assert_int_equal(1, (int) ec_history_read(&reader->history, &cursor, &seen, 1, NULL), "reader sees history");
+
+        // the reader's mapping is read-only
+        pid_t child = fork();
+        if (child == 0) {
+            ((volatile ec_shm_t*) reader)->header.live = 0;
+            _exit(0);
+        }
+        int status = 0;
+        waitpid(child, &status, 0);
+        test_assert_true(WIFSIGNALED(status), "reader cannot write");
+        ec_shm_detach(reader);
+    }
+
+    // A segment someone else could have forged is not believed
+    int fd = shm_open(EC_SHM_NAME, O_RDWR | O_CLOEXEC, 0);
+    test_assert_true(fd >= 0, "segment reopened");
+    fchmod(fd, 0666);
+    test_assert_true(ec_shm_attach() == NULL && errno == EACCES, "writable segment refused");
+    fchmod(fd, 0644);
+    if (geteuid() == 0) {
+        fchown(fd, 65534, 65534);
+        test_assert_true(ec_shm_attach() == NULL && errno == EACCES, "foreign segment refused");
+        fchown(fd, 0, 0);
+    }
+    const ec_shm_t* trusted = ec_shm_attach();
+    test_assert_true(trusted != NULL, "own segment attaches again");
+    ec_shm_detach(trusted);
+    close(fd);
+
+    ec_shm_destroy(writer);
+    test_assert_true(ec_shm_attach() == NULL, "segment gone with its writer");
+}
+
+void test_startup_path(void) {
+    printf("Testing startup module check and backend cache...\n");
+    // a loaded module is a single stat, nothing is spawned
+    mkdir(EC_SYS_MODULE_PATH, 0755);
+    uint64_t start = ec_stats_now_ns();
+    test_assert_int_equal(EXIT_SUCCESS, ec_sysfs_load_module(), "loaded module detected");
+    test_assert_true(ec_stats_now_ns() - start < 1000000, "module check is cheap");
+    rmdir(EC_SYS_MODULE_PATH);
+
+    unlink(EC_BACKEND_CACHE_PATH);
+    test_assert_int_equal(EC_BACKEND_AUTO, ec_backend_cached(), "empty cache");
+    ec_backend_remember(EC_BACKEND_PORT);
+    test_assert_int_equal(EC_BACKEND_PORT, ec_backend_cached(), "port remembered");
+    ec_backend_remember(EC_BACKEND_SYSFS);
+    test_assert_int_equal(EC_BACKEND_SYSFS, ec_backend_cached(), "sysfs replaces port");
+    ec_backend_remember(EC_BACKEND_MOCK);
+    test_assert_int_equal(EC_BACKEND_SYSFS, ec_backend_cached(), "mock is never cached");
+
+    // with the cached backend available, auto open uses it without probing
+    unsigned char image[0x100] = {0};
+    FILE* fp = fopen(EC_SYSFS_PATH, "wb");
+    test_assert_true(fp != NULL, "create fake ec_sys io file");
+    fwrite(image, 1, sizeof(image), fp);
+    fclose(fp);
+    ec_backend_t* backend = ec_backend_open(EC_BACKEND_AUTO);
+    test_assert_true(backend != NULL && backend->type == EC_BACKEND_SYSFS, "auto opens the cached backend");
+    if (backend != NULL)
+        ec_backend_close(backend);
+    unlink(EC_BACKEND_CACHE_PATH);
+    unlink(EC_SYSFS_PATH);
+}
+
+void test_single_instance(void) {
+    printf("Testing single-instance guard and command forwarding...\n");
+    int fd = ec_instance_claim();
+    test_assert_true(fd >= 0, "first instance claims");
+    if (fd < 0)
+        return;
+    test_assert_int_equal(-1, ec_instance_claim(), "second instance refused");
+    test_assert_int_equal(EADDRINUSE, errno, "refusal says another instance runs");
+
+    pid_t child = fork();
+    if (child == 0)
+        _exit(ec_instance_forward(EC_COMMAND_SET_DUTY, 80));
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    test_assert_int_equal(1, poll(&pfd, 1, 1000), "forwarded command arrives");
+    ec_command_t command = {0};
+    int sender = ec_instance_accept(fd);
+    test_assert_true(sender >= 0, "sender accepted");
+    pfd.fd = sender;
+    poll(&pfd, 1, 1000);
+    test_assert_int_equal(1, ec_instance_serve(sender, &command), "command accepted");
+    test_assert_int_equal(EC_COMMAND_SET_DUTY, (int) command.type, "forwarded type");
+    test_assert_int_equal(80, command.value, "forwarded duty");
+    int status = 0;
+    waitpid(child, &status, 0);
+    test_assert_true(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS, "sender sees the acceptance");
+    test_assert_int_equal(1, ec_instance_trusted(), "own instance is trusted");
+    sender = ec_instance_accept(fd);
+    test_assert_int_equal(-1, ec_instance_serve(sender, &command), "hung-up sender dropped");
+
+    // A sender that connects and never writes costs the loop nothing
+    int silent = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    memcpy(addr.sun_path + 1, EC_INSTANCE_NAME, strlen(EC_INSTANCE_NAME));
+    connect(silent, (struct sockaddr*) &addr,
+            (socklen_t) (offsetof(struct sockaddr_un, sun_path) + 1 + strlen(EC_INSTANCE_NAME)));
+    sender = ec_instance_accept(fd);
+    test_assert_true(sender >= 0, "silent sender accepted");
+    uint64_t start = ec_stats_now_ns();
+    test_assert_int_equal(0, ec_instance_serve(sender, &command), "silent sender left waiting");
+    test_assert_true(ec_stats_now_ns() - start < 5000000ULL, "serving does not block");
+    int pending[EC_INSTANCE_MAX_SENDERS];
+    test_assert_int_equal(1, ec_instance_pending(pending), "silent sender pending");
+    close(silent);
+    test_assert_int_equal(-1, ec_instance_serve(sender, &command), "silent sender dropped on hang-up");
+    close(fd);
+
+    // Another user squatting the name is not believed
+    if (geteuid() == 0) {
+        int ready[2];
+        test_assert_int_equal(0, pipe(ready), "pipe");
+        child = fork();
+        if (child == 0) {
+            if (setuid(65534) != 0 || ec_instance_claim() < 0)
+                _exit(1);
+            ssize_t written = write(ready[1], "x", 1);
+            pause();
+            _exit(written == 1 ? 0 : 1);
+        }
+        char byte;
+        test_assert_int_equal(1, (int) read(ready[0], &byte, 1), "squatter holds the name");
+        test_assert_int_equal(0, ec_instance_trusted(), "squatter is not trusted");
+        test_assert_int_equal(EXIT_FAILURE, ec_instance_forward(EC_COMMAND_SET_DUTY, 80), "nothing forwarded to a squatter");
+        test_assert_int_equal(EACCES, errno, "refusal names the permission problem");
+        kill(child, SIGKILL);
+        waitpid(child, &status, 0);
+        close(ready[0]);
+        close(ready[1]);
+    }
+
+
+    test_assert_int_equal(EXIT_FAILURE, ec_instance_forward(EC_COMMAND_SET_AUTO, 0), "nobody to forward to");
+    fd = ec_instance_claim();
+    test_assert_true(fd >= 0, "claim released with the socket");
+    close(fd);
+}
+
+void test_daemon_protocol(void) {
+    printf("Testing daemon socket protocol...\n");
+    test_assert_int_equal(48, (int) sizeof(ec_msg_t), "compact fixed-size messages");
+    test_assert_int_equal(-1, ec_client_connect(), "no daemon yet");
+    static ec_daemon_t daemon;
+    test_assert_int_equal(EXIT_SUCCESS, ec_daemon_listen(&daemon), "daemon listens");
+
+    // subscription: one broadcast reaches the client without a request
+    int fd = ec_client_connect();
+    test_assert_true(fd >= 0, "client connects");
+    int server_fd = ec_daemon_accept(&daemon);
+    test_assert_true(server_fd >= 0, "daemon accepts");
+    ec_telemetry_t latest = {0};
+    ec_command_t command;
+    ec_client_subscribe(fd);
+    test_assert_int_equal(EC_MSG_SUBSCRIBE, ec_daemon_serve(&daemon, server_fd, &latest, &command), "subscribe served");
+    latest.sequence = 1;
+    latest.cpu_temp = 66;
+    ec_daemon_broadcast(&daemon, &latest);
+    ec_telemetry_t pushed = {0};
+    test_assert_int_equal(EXIT_SUCCESS, ec_client_next(fd, &pushed), "pushed sample received");
+    test_assert_int_equal(66, pushed.cpu_temp, "pushed sample content");
+
+    // command round trip; the client waits for the answer, so run it apart
+    pid_t child = fork();
+    if (child == 0)
+        _exit(ec_client_command(EC_COMMAND_SET_DUTY, 70));
+    struct pollfd pfd = { .fd = daemon.listen_fd, .events = POLLIN };
+    poll(&pfd, 1, 1000);
+    int command_fd = ec_daemon_accept(&daemon);
+    pfd.fd = command_fd;
+    poll(&pfd, 1, 1000);
+    test_assert_int_equal(EC_MSG_COMMAND, ec_daemon_serve(&daemon, command_fd, &latest, &command), "command served");
+    test_assert_int_equal(70, command.value, "command value");
+    ec_daemon_reply(command_fd, 0);
+    int status = 0;
+    waitpid(child, &status, 0);
+    test_assert_true(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS, "client sees the command applied");
+
+    // Unprivileged senders are judged by the groups the kernel recorded
+    // at connect time: one in the group may command, anyone else gets EPERM
+    if (geteuid() == 0) {
+        daemon.has_group = 1;
+        daemon.group_gid = 4242;
+        for (int member = 1; member >= 0; member--) {
+            child = fork();
+            if (child == 0) {
+                gid_t group = member ? 4242 : 4343;
+                if (setgroups(1, &group) != 0 || setgid(65534) != 0 || setuid(65534) != 0)
+                    _exit(2);
+                if (ec_client_command(EC_COMMAND_SET_AUTO, 0) == EXIT_SUCCESS)
+                    _exit(0);
+                _exit(errno == EPERM ? 1 : 2);
+            }
+            pfd.fd = daemon.listen_fd;
+            poll(&pfd, 1, 1000);
+            command_fd = ec_daemon_accept(&daemon);
+            pfd.fd = command_fd;
+            poll(&pfd, 1, 1000);
+            if (ec_daemon_serve(&daemon, command_fd, &latest, &command) == EC_MSG_COMMAND)
+                ec_daemon_reply(command_fd, 0);
+            waitpid(child, &status, 0);
+            test_assert_int_equal(member ? 0 : 1, WEXITSTATUS(status),
+                    member ? "group member may command" : "non-member refused with EPERM");
+        }
+    }
+
+    close(fd);
+    test_assert_int_equal(-1, ec_daemon_serve(&daemon, server_fd, &latest, &command), "hang-up drops the client");
+    ec_daemon_close(&daemon);
+    test_assert_int_equal(-1, ec_client_connect(), "socket removed with the daemon");
+}
+
+void test_realtime_option(void) {
+    printf("Testing real-time worker option...\n");
+
+    test_assert_int_equal(EC_RT_FIFO, ec_rt_parse("fifo"), "fifo parses");
+    test_assert_int_equal(EC_RT_DEADLINE, ec_rt_parse("deadline"), "deadline parses");
+    test_assert_int_equal(-1, ec_rt_parse("rr"), "unknown policy rejected");
+    test_assert_int_equal(EC_RT_NONE, ec_rt_config()->policy, "real-time mode is off by default");
+    test_assert_int_equal(EXIT_SUCCESS, ec_rt_apply(), "no policy is a no-op");
+
+    int wake_fd = ec_loop_wake_fd();
+    ec_loop_t loop;
+    test_assert_int_equal(EXIT_SUCCESS, ec_loop_open(&loop, wake_fd, NULL), "loop opens");
+    uint64_t ticks = ec_stats_get()->loop.jitter.count;
+    ec_loop_set_period(&loop, 10);
+    for (int i = 0; i < 3; i++)
+        ec_loop_wait(&loop);
+    test_assert_true(ec_stats_get()->loop.jitter.count >= ticks + 3, "timer ticks recorded in the jitter histogram");
+    ec_loop_close(&loop);
+    close(wake_fd);
+}
+
+// Write one attribute of a fake power supply
+static void write_supply(const char* supply, const char* attribute, const char* value) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", EC_POWER_SUPPLY_PATH, supply);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/%s/%s", EC_POWER_SUPPLY_PATH, supply, attribute);
+    FILE* fp = fopen(path, "w");
+    if (fp != NULL) {
+        fprintf(fp, "%s\n", value);
+        fclose(fp);
+    }
+}
+
+void test_power_aware(void) {
+    printf("Testing power-aware scheduling...\n");
+
+    mkdir(EC_POWER_SUPPLY_PATH, 0755);
+    test_assert_int_equal(0, ec_power_on_battery(), "no battery means mains power");
+    write_supply("hidpp_battery_0", "type", "Battery");
+    write_supply("hidpp_battery_0", "scope", "Device");
+    test_assert_int_equal(0, ec_power_on_battery(), "a mouse battery does not count");
+    write_supply("BAT0", "type", "Battery");
+    write_supply("AC", "type", "Mains");
+    write_supply("AC", "online", "0");
+    test_assert_int_equal(1, ec_power_on_battery(), "unplugged laptop runs on battery");
+    write_supply("AC", "online", "1");
+    test_assert_int_equal(0, ec_power_on_battery(), "plugged laptop runs on AC");
+    test_assert_int_equal(0, ec_power_battery(ec_stats_now_ns()), "battery state cached");
+    write_supply("AC", "online", "0");
+    test_assert_int_equal(0, ec_power_battery(ec_stats_now_ns()), "cache holds until the recheck interval");
+    const char* files[] = { "hidpp_battery_0/type", "hidpp_battery_0/scope", "BAT0/type", "AC/type", "AC/online" };
+    const char* supplies[] = { "hidpp_battery_0", "BAT0", "AC" };
+    char path[512];
+    for (int i = 0; i < 5; i++) {
+        snprintf(path, sizeof(path), "%s/%s", EC_POWER_SUPPLY_PATH, files[i]);
+        unlink(path);
+    }
+    for (int i = 0; i < 3; i++) {
+        snprintf(path, sizeof(path), "%s/%s", EC_POWER_SUPPLY_PATH, supplies[i]);
+        rmdir(path);
+    }
+    rmdir(EC_POWER_SUPPLY_PATH);
+
+    test_assert_int_equal(500, (int) ec_power_period(500, 0), "tick multiples are kept");
+    test_assert_int_equal(700, (int) ec_power_period(675, 0), "periods round up to the tick");
+    test_assert_int_equal(1000, (int) ec_power_period(500, 1), "battery stretches the period");
+    unsigned int delay = ec_power_delay_ms(500);
+    test_assert_true(delay >= 1 && delay <= 500, "delay lands within one period");
+
+    ec_power_config()->timer_slack_us = 20000;
+    test_assert_int_equal(EXIT_SUCCESS, ec_power_apply_slack(), "timer slack set");
+    test_assert_int_equal(20000000, prctl(PR_GET_TIMERSLACK, 0, 0, 0, 0), "kernel reports the slack");
+    prctl(PR_SET_TIMERSLACK, 0, 0, 0, 0);  // back to the default
+
+    int wake_fd = ec_loop_wake_fd();
+    ec_loop_t loop;
+    test_assert_int_equal(EXIT_SUCCESS, ec_loop_open(&loop, wake_fd, NULL), "loop opens");
+    ec_loop_set_period(&loop, EC_POWER_TICK_MS);
+    test_assert_int_equal(EXIT_SUCCESS, ec_loop_align(&loop, 1), "loop aligns");
+    test_assert_int_equal(0, (int) (loop.next_tick_ns % (EC_POWER_TICK_MS * 1000000ULL)), "first tick on the grid");
+    test_assert_int_equal(EC_LOOP_TIMER, ec_loop_wait(&loop), "aligned timer fires");
+    test_assert_true(ec_stats_now_ns() % (EC_POWER_TICK_MS * 1000000ULL) < 20000000ULL, "woke close to the grid");
+    ec_loop_close(&loop);
+    close(wake_fd);
+
+    test_assert_true(ec_power_cpu_ns() > 0, "process CPU time measured");
+}
+
+void test_iteration_metrics(void) {
+    printf("Testing worker iteration metrics...\n");
+
+    ec_loop_stats_t* stats = &ec_stats_get()->loop;
+    uint64_t iterations = stats->iterations;
+    uint64_t misses = stats->deadline_misses;
+    uint64_t writes = stats->phases[EC_PHASE_WRITE].count;
+    stats->slo_ms = 10;
+    uint64_t phases[EC_PHASE_COUNT] = { 3000000, 1000000, 0, 500000 };
+    ec_stats_record_iteration(1000000000ULL, 1005000000ULL, phases);
+    test_assert_int_equal(0, (int) (stats->deadline_misses - misses), "iteration within the SLO");
+    ec_stats_record_iteration(1000000000ULL, 1020000000ULL, phases);
+    test_assert_int_equal(1, (int) (stats->deadline_misses - misses), "late iteration misses its deadline");
+    test_assert_int_equal(2, (int) (stats->iterations - iterations), "iterations counted");
+    test_assert_int_equal(2, (int) (stats->phases[EC_PHASE_WRITE].count - writes), "every phase recorded");
+    test_assert_true(strcmp(ec_phase_name(EC_PHASE_READ), "ec read") == 0, "phase named");
+
+    int wake_fd = ec_loop_wake_fd();
+    ec_loop_t loop;
+    test_assert_int_equal(EXIT_SUCCESS, ec_loop_open(&loop, wake_fd, NULL), "loop opens");
+    ec_loop_set_period(&loop, 10);
+    uint64_t tick_ns = loop.next_tick_ns;
+    test_assert_int_equal(EC_LOOP_TIMER, ec_loop_wait(&loop), "timer fires");
+    test_assert_true(loop.due_ns == tick_ns, "timer wakeup due at its expiration");
+    ec_loop_set_period(&loop, EC_LOOP_MAX_PERIOD_MS);
+    uint64_t rung_ns = ec_stats_now_ns();
+    ec_loop_wake(wake_fd);
+    test_assert_int_equal(EC_LOOP_WAKE, ec_loop_wait(&loop), "wake fires");
+    test_assert_true(loop.due_ns >= rung_ns, "command wakeup due when it woke");
+    ec_loop_close(&loop);
+    close(wake_fd);
+    stats->slo_ms = EC_LOOP_DEFAULT_SLO_MS;
+}
+
+void test_fan_pid(void) {
+    printf("Testing PID fan controller...\n");
+    const uint64_t ms = 1000000ULL;
+
+    fan_pid_config_t saved = *fan_pid_config();
+    test_assert_int_equal(EXIT_FAILURE, fan_pid_parse_gains("5,0.2"), "two gains rejected");
+    test_assert_int_equal(EXIT_FAILURE, fan_pid_parse_gains("5,-1,6"), "negative gain rejected");
+    test_assert_int_equal(EXIT_SUCCESS, fan_pid_parse_gains("2.5,0.5,1"), "gains parsed");
+    test_assert_int_equal(FAN_PID_FIX(2.5), fan_pid_config()->kp, "kp in fixed point");
+    *fan_pid_config() = saved;
+
+    fan_pid_t pid;
+    memset(&pid, 0, sizeof(pid));
+    test_assert_int_equal(40, fan_pid_update(&pid, 70, 65, 40, 1000 * ms), "first update keeps the current duty");
+
+    // Output slews at rise_pct_s however hot it gets
+    int duty = fan_pid_update(&pid, 95, 65, 40, 1200 * ms);
+    test_assert_true(duty > 40 && duty <= 40 + (int) fan_pid_config()->rise_pct_s / 5 + 1, "rise rate limited");
+
+    // Pinned at 100% for ten minutes, the integral must not wind up
+    uint64_t now = 1200 * ms;
+    for (int i = 0; i < 3000; i++)
+        duty = fan_pid_update(&pid, 95, 65, duty, now += 200 * ms);
+    test_assert_int_equal(100, duty, "saturates at full duty");
+    for (int i = 0; i < 150; i++)
+        duty = fan_pid_update(&pid, 55, 65, duty, now += 200 * ms);
+    test_assert_true(duty < 100, "backs off within 30 s of cooling below target");
+
+    // Closed loop against the simulator: a load step settles without
+    // overshooting much and with few EC writes
+    ec_sim_config_t* config = ec_sim_config();
+    double saved_scale = config->time_scale;
+    config->time_scale = 0;
+    ec_backend_t* sim = ec_backend_open(EC_BACKEND_SIM);
+    const uint8_t regs[] = { EC_REG_CPU_TEMP, EC_REG_GPU_TEMP, EC_REG_FAN_DUTY };
+    uint8_t values[3];
+    ec_backend_write(sim, EC_CMD_FAN_DUTY, EC_FAN_DUTY_PORT, 0);
+    ec_sim_set_load(sim, 8.0, 5.0);
+    ec_sim_advance(sim, 1800ULL * 1000 * ms);
+    ec_controller_stats_t* stats = &ec_stats_get()->controller;
+    uint64_t settled = stats->settled;
+    memset(&pid, 0, sizeof(pid));
+    int written = 0, writes = 0, temp = 0;
+    // A minute idle, then five under a compile-like load
+    for (int i = 0; i < 6 * 60 * 5; i++) {
+        if (i == 60 * 5)
+            ec_sim_set_load(sim, 45.0, 30.0);
+        ec_backend_read_batch(sim, regs, values, 3);
+        temp = values[0] > values[1] ? values[0] : values[1];
+        ec_sim_state(sim, &now, NULL, NULL, NULL);
+        duty = fan_pid_update(&pid, temp, 65, values[2] * 100 / 255, now);
+        if (duty != written) {
+            ec_backend_write(sim, EC_CMD_FAN_DUTY, EC_FAN_DUTY_PORT, duty * 255 / 100);
+            written = duty;
+            writes++;
+        }
+        ec_sim_advance(sim, 200 * ms);
+    }
+    test_assert_true(temp >= 63 && temp <= 67, "load step settles at the target");
+    test_assert_true(stats->last_overshoot_c <= 4, "overshoot stays small");
+    test_assert_true(stats->settled > settled, "settling recorded");
+    test_assert_true(writes < 80, "few duty writes");  // the old ±2% stepper made ~1500
+    ec_backend_close(sim);
+    config->time_scale = saved_scale;
+}
+
 void run_all_tests(void) {
     printf("Running Clevo Indicator Tests...\n");
     printf("================================\n");
@@ -161,6 +1261,29 @@ void run_all_tests(void) {
     test_string_formatting();
     test_mock_ec_functions();
     test_edge_cases();
+    test_histogram();
+    test_op_stats();
+    test_mock_backend();
+    test_sysfs_backend();
+    test_register_cache();
+    test_duty_write_pipeline();
+    test_bus_lock();
+    test_incremental_snapshot();
+    test_port_error_policy();
+    test_thermal_simulator();
+    test_trace_roundtrip();
+    test_worker_loop();
+    test_telemetry_seqlock();
+    test_command_ring();
+    test_telemetry_history();
+    test_telemetry_segment();
+    test_startup_path();
+    test_single_instance();
+    test_daemon_protocol();
+    test_realtime_option();
+    test_power_aware();
+    test_iteration_metrics();
+    test_fan_pid();
     
     printf("================================\n");
     printf("All tests passed!\n");